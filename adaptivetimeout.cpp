@@ -0,0 +1,121 @@
+/** @file adaptivetimeout.cpp
+ * @brief Request timeouts derived from measured latencies, and retry backoff.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "adaptivetimeout.hpp"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace CloudSync {
+
+struct AdaptiveTimeout::AdaptiveTimeoutImpl {
+	int initialMs;
+	int minMs;
+	int maxMs;
+
+	double percentile = 0.95;
+	double multiplier = 2.0;
+	int marginMs = 500;
+	size_t minSamples = 8;
+
+	/**
+	 * @brief A ring buffer of the most recent latencies in milliseconds.
+	 */
+	std::vector<double> window;
+
+	/**
+	 * @brief The index in the window that the next latency will be written to.
+	 */
+	size_t next = 0;
+
+	/**
+	 * @brief The number of latencies in the window, which stops growing once the window is full.
+	 */
+	size_t count = 0;
+
+	/**
+	 * @brief Needed to prevent data races.
+	 */
+	mutable std::mutex m;
+};
+
+AdaptiveTimeout::AdaptiveTimeout(int initialMs, int minMs, int maxMs, size_t windowSize): impl(std::make_unique<AdaptiveTimeoutImpl>()) {
+	if (minMs > maxMs) {
+		throw std::invalid_argument("minMs cannot be greater than maxMs");
+	}
+	if (windowSize == 0) {
+		throw std::invalid_argument("windowSize must be at least 1");
+	}
+	this->impl->initialMs = initialMs;
+	this->impl->minMs = minMs;
+	this->impl->maxMs = maxMs;
+	this->impl->window.resize(windowSize);
+}
+
+AdaptiveTimeout::AdaptiveTimeout(AdaptiveTimeout&& other) noexcept = default;
+AdaptiveTimeout& AdaptiveTimeout::operator=(AdaptiveTimeout&& other) noexcept = default;
+AdaptiveTimeout::~AdaptiveTimeout() = default;
+
+void AdaptiveTimeout::record(std::chrono::steady_clock::duration latency) {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->window[this->impl->next] = std::chrono::duration<double, std::milli>(latency).count();
+	this->impl->next = (this->impl->next + 1) % this->impl->window.size();
+	this->impl->count = std::min(this->impl->count + 1, this->impl->window.size());
+}
+
+int AdaptiveTimeout::getTimeoutMs() const {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	const AdaptiveTimeoutImpl& t = *this->impl;
+
+	if (t.count < t.minSamples) {
+		return std::clamp(t.initialMs, t.minMs, t.maxMs);
+	}
+
+	// The window is small, so copying it for nth_element is cheaper than keeping it sorted.
+	std::vector<double> samples(t.window.begin(), t.window.begin() + t.count);
+	size_t index = std::min(static_cast<size_t>(t.percentile * samples.size()), samples.size() - 1);
+	std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+
+	double timeout = samples[index] * t.multiplier + t.marginMs;
+	return static_cast<int>(std::clamp(timeout, static_cast<double>(t.minMs), static_cast<double>(t.maxMs)));
+}
+
+std::vector<std::chrono::milliseconds> AdaptiveTimeout::getLatencies() const {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	const AdaptiveTimeoutImpl& t = *this->impl;
+	std::vector<std::chrono::milliseconds> ret;
+
+	ret.reserve(t.count);
+	// Until the window is full, the oldest latency is at index 0.
+	size_t first = t.count < t.window.size() ? 0 : t.next;
+	for (size_t i = 0; i < t.count; ++i) {
+		ret.emplace_back(std::lround(t.window[(first + i) % t.window.size()]));
+	}
+	return ret;
+}
+
+AdaptiveTimeout& AdaptiveTimeout::setPolicy(double percentile, double multiplier, int marginMs, size_t minSamples) {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->percentile = std::clamp(percentile, 0.0, 1.0);
+	this->impl->multiplier = multiplier;
+	this->impl->marginMs = marginMs;
+	this->impl->minSamples = std::max(minSamples, static_cast<size_t>(1));
+	return *this;
+}
+
+std::chrono::milliseconds RetryPolicy::delay(int retry) const {
+	static thread_local std::mt19937 rng(std::random_device{}());
+	double base = std::min(static_cast<double>(this->maxDelayMs), this->baseDelayMs * std::pow(2.0, retry));
+	double jitter = std::uniform_real_distribution<double>(0.75, 1.0)(rng);
+	return std::chrono::milliseconds(static_cast<long>(base * jitter));
+}
+
+}
@@ -0,0 +1,106 @@
+/** @file adaptivetimeout.hpp
+ * @brief Request timeouts derived from measured latencies, and retry backoff.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#ifndef __CS_ADAPTIVETIMEOUT_HPP
+#define __CS_ADAPTIVETIMEOUT_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace CloudSync{
+
+/**
+ * @brief Computes a request timeout from a rolling window of measured request latencies.
+ * The timeout is a high percentile of the window times a multiplier plus a fixed margin, clamped to a range.
+ * Until enough latencies have been measured, the initial timeout is used.
+ * This class is thread-safe.
+ */
+class AdaptiveTimeout {
+public:
+	/**
+	 * @brief Constructs an AdaptiveTimeout.
+	 *
+	 * @param initialMs The timeout to use until enough latencies have been measured.
+	 * @param minMs The smallest timeout that will be returned.
+	 * @param maxMs The largest timeout that will be returned.
+	 * @param windowSize How many of the most recent latencies are considered.
+	 *
+	 * @exception std::invalid_argument minMs is greater than maxMs, or windowSize is 0.
+	 */
+	AdaptiveTimeout(int initialMs = 10000, int minMs = 1000, int maxMs = 120000, size_t windowSize = 64);
+
+	AdaptiveTimeout(AdaptiveTimeout&& other) noexcept;
+	AdaptiveTimeout& operator=(AdaptiveTimeout&& other) noexcept;
+	~AdaptiveTimeout();
+
+	/**
+	 * @brief Records the latency of a request that finished.
+	 * Requests that timed out should not be recorded, as their true latency is unknown.
+	 */
+	void record(std::chrono::steady_clock::duration latency);
+
+	/**
+	 * @brief Gets the timeout to use for the next request in milliseconds.
+	 */
+	int getTimeoutMs() const;
+
+	/**
+	 * @brief Gets the latencies in the window, oldest first.
+	 * Recording them into a new AdaptiveTimeout carries the measurements over, so requests made once per session still adapt across sessions.
+	 */
+	std::vector<std::chrono::milliseconds> getLatencies() const;
+
+	/**
+	 * @brief Sets how the timeout is derived from the window.
+	 *
+	 * @param percentile The percentile of the window to use, from 0 to 1.
+	 * @param multiplier The factor the percentile is multiplied by.
+	 * @param marginMs A fixed number of milliseconds added on top.
+	 * @param minSamples How many latencies must be measured before the window is used instead of the initial timeout.
+	 *
+	 * @return this
+	 */
+	AdaptiveTimeout& setPolicy(double percentile, double multiplier, int marginMs, size_t minSamples);
+
+private:
+	struct AdaptiveTimeoutImpl;
+	std::unique_ptr<AdaptiveTimeoutImpl> impl;
+};
+
+/**
+ * @brief How often and how long to wait before retrying a failed request.
+ */
+struct RetryPolicy {
+	/**
+	 * @brief The number of retries after the first attempt. 0 disables retrying.
+	 */
+	int maxRetries = 3;
+
+	/**
+	 * @brief The delay before the first retry in milliseconds. Every following retry doubles it.
+	 */
+	int baseDelayMs = 500;
+
+	/**
+	 * @brief The largest delay between two attempts in milliseconds.
+	 */
+	int maxDelayMs = 30000;
+
+	/**
+	 * @brief Gets the delay before the given retry, with up to 25% random jitter so that clients do not retry in lockstep.
+	 *
+	 * @param retry The retry that is about to be made, starting at 0.
+	 */
+	std::chrono::milliseconds delay(int retry) const;
+};
+
+}
+
+#endif
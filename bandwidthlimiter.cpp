@@ -0,0 +1,207 @@
+/** @file bandwidthlimiter.cpp
+ * @brief Caps the aggregate upload and download rates of a session, with separate limits for business hours.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "bandwidthlimiter.hpp"
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+namespace CloudSync {
+
+struct TokenBucket::TokenBucketImpl {
+	uint64_t rate = 0;
+	double capacity = 0;
+
+	/**
+	 * @brief The bytes currently in the bucket. This goes negative when a request is let through on credit.
+	 */
+	double tokens = 0;
+
+	/**
+	 * @brief The last time the tokens were topped up.
+	 */
+	std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+
+	/**
+	 * @brief Needed to prevent data races.
+	 */
+	mutable std::mutex m;
+
+	/**
+	 * @brief Adds the tokens that accumulated since the last refill. The mutex must be held.
+	 */
+	void refill() {
+		auto now = std::chrono::steady_clock::now();
+		tokens = std::min(capacity, tokens + std::chrono::duration<double>(now - last).count() * rate);
+		last = now;
+	}
+};
+
+TokenBucket::TokenBucket(uint64_t bytesPerSecond, uint64_t burst): impl(std::make_unique<TokenBucketImpl>()) {
+	this->setRate(bytesPerSecond, burst);
+}
+
+TokenBucket::TokenBucket(TokenBucket&& other) noexcept = default;
+
+TokenBucket& TokenBucket::operator=(TokenBucket&& other) noexcept = default;
+
+TokenBucket::~TokenBucket() = default;
+
+void TokenBucket::acquire(uint64_t bytes) {
+	std::chrono::duration<double> wait(0);
+
+	{
+		std::lock_guard<std::mutex> lock(this->impl->m);
+		if (this->impl->rate == 0) {
+			return;
+		}
+		this->impl->refill();
+		this->impl->tokens -= bytes;
+		if (this->impl->tokens < 0) {
+			wait = std::chrono::duration<double>(-this->impl->tokens / this->impl->rate);
+		}
+	}
+
+	if (wait.count() > 0) {
+		std::this_thread::sleep_for(wait);
+	}
+}
+
+bool TokenBucket::tryAcquire(uint64_t bytes) {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	if (this->impl->rate == 0) {
+		return true;
+	}
+	this->impl->refill();
+	if (this->impl->tokens < bytes) {
+		return false;
+	}
+	this->impl->tokens -= bytes;
+	return true;
+}
+
+void TokenBucket::setRate(uint64_t bytesPerSecond, uint64_t burst) {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	// Settle the tokens earned at the old rate first.
+	this->impl->refill();
+	// An unlimited bucket gets a full one, as if it had been limited all along without anything going through.
+	const bool wasUnlimited = this->impl->rate == 0;
+	this->impl->rate = bytesPerSecond;
+	this->impl->capacity = burst > 0 ? burst : bytesPerSecond;
+	this->impl->tokens = wasUnlimited ? this->impl->capacity : std::min(this->impl->tokens, this->impl->capacity);
+}
+
+uint64_t TokenBucket::getRate() const {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	return this->impl->rate;
+}
+
+bool BandwidthLimits::operator==(const BandwidthLimits& other) const {
+	return uploadBytesPerSecond == other.uploadBytesPerSecond && downloadBytesPerSecond == other.downloadBytesPerSecond;
+}
+
+bool BandwidthLimits::operator!=(const BandwidthLimits& other) const {
+	return !(*this == other);
+}
+
+BandwidthLimits BandwidthSchedule::limitsAt(std::time_t t) const {
+	struct tm local;
+	bool business;
+
+	localtime_r(&t, &local);
+	if (weekendsOff && (local.tm_wday == 0 || local.tm_wday == 6)) {
+		return offHours;
+	}
+
+	if (businessStartHour <= businessEndHour) {
+		business = local.tm_hour >= businessStartHour && local.tm_hour < businessEndHour;
+	}
+	else {
+		business = local.tm_hour >= businessStartHour || local.tm_hour < businessEndHour;
+	}
+	return business ? businessHours : offHours;
+}
+
+struct BandwidthLimiter::BandwidthLimiterImpl {
+	BandwidthSchedule schedule;
+
+	/**
+	 * @brief The limits the buckets are currently set to.
+	 */
+	BandwidthLimits current;
+
+	TokenBucket upload;
+	TokenBucket download;
+
+	/**
+	 * @brief The next time the schedule has to be re-evaluated.
+	 */
+	std::chrono::steady_clock::time_point nextCheck;
+
+	/**
+	 * @brief Needed to prevent data races. The buckets have their own locks, so this is not held while waiting on them.
+	 */
+	mutable std::mutex m;
+
+	/**
+	 * @brief Sets the buckets to the limits of the schedule if a second has passed since it was last evaluated. The mutex must be held.
+	 *
+	 * @param force Re-evaluate the schedule even if a second has not passed.
+	 */
+	void update(bool force) {
+		auto now = std::chrono::steady_clock::now();
+		if (!force && now < nextCheck) {
+			return;
+		}
+		nextCheck = now + std::chrono::seconds(1);
+
+		BandwidthLimits limits = schedule.limitsAt(std::time(nullptr));
+		if (force || limits != current) {
+			upload.setRate(limits.uploadBytesPerSecond);
+			download.setRate(limits.downloadBytesPerSecond);
+			current = limits;
+		}
+	}
+};
+
+BandwidthLimiter::BandwidthLimiter(const BandwidthSchedule& schedule): impl(std::make_unique<BandwidthLimiterImpl>()) {
+	this->setSchedule(schedule);
+}
+
+BandwidthLimiter::BandwidthLimiter(BandwidthLimiter&& other) noexcept = default;
+
+BandwidthLimiter& BandwidthLimiter::operator=(BandwidthLimiter&& other) noexcept = default;
+
+BandwidthLimiter::~BandwidthLimiter() = default;
+
+void BandwidthLimiter::setSchedule(const BandwidthSchedule& schedule) {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->schedule = schedule;
+	this->impl->update(true);
+}
+
+BandwidthSchedule BandwidthLimiter::getSchedule() const {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	return this->impl->schedule;
+}
+
+BandwidthLimits BandwidthLimiter::getCurrentLimits() const {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->update(false);
+	return this->impl->current;
+}
+
+void BandwidthLimiter::acquire(TransferType type, uint64_t bytes) {
+	{
+		std::lock_guard<std::mutex> lock(this->impl->m);
+		this->impl->update(false);
+	}
+	(type == TransferType::Upload ? this->impl->upload : this->impl->download).acquire(bytes);
+}
+
+}
@@ -0,0 +1,160 @@
+/** @file bandwidthlimiter.hpp
+ * @brief Caps the aggregate upload and download rates of a session, with separate limits for business hours.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#ifndef __CS_BANDWIDTHLIMITER_HPP
+#define __CS_BANDWIDTHLIMITER_HPP
+
+#include "transferqueue.hpp"
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+
+namespace CloudSync{
+
+/**
+ * @brief A token bucket that refills at a fixed rate and lets bursts up to its capacity through at once.
+ * This class is thread-safe.
+ */
+class TokenBucket {
+public:
+	/**
+	 * @brief Constructs a TokenBucket, which starts full.
+	 *
+	 * @param bytesPerSecond The rate the bucket refills at, or 0 for unlimited.
+	 * @param burst The capacity of the bucket in bytes, or 0 for one second's worth of the rate.
+	 */
+	TokenBucket(uint64_t bytesPerSecond = 0, uint64_t burst = 0);
+
+	TokenBucket(TokenBucket&& other) noexcept;
+	TokenBucket& operator=(TokenBucket&& other) noexcept;
+	~TokenBucket();
+
+	/**
+	 * @brief Takes bytes out of the bucket, blocking until the rate allows them through.
+	 * Requests larger than the bucket are let through on credit and delay the requests after them, so they cannot starve.
+	 */
+	void acquire(uint64_t bytes);
+
+	/**
+	 * @brief Takes bytes out of the bucket if it holds enough of them.
+	 *
+	 * @return True if the bytes were taken, false if the caller would have had to wait.
+	 */
+	bool tryAcquire(uint64_t bytes);
+
+	/**
+	 * @brief Changes the rate and capacity of the bucket. Requests already waiting are not sped up.
+	 *
+	 * @param bytesPerSecond The rate the bucket refills at, or 0 for unlimited.
+	 * @param burst The capacity of the bucket in bytes, or 0 for one second's worth of the rate.
+	 */
+	void setRate(uint64_t bytesPerSecond, uint64_t burst = 0);
+
+	/**
+	 * @brief Gets the rate the bucket refills at in bytes per second, or 0 if unlimited.
+	 */
+	uint64_t getRate() const;
+
+private:
+	struct TokenBucketImpl;
+	std::unique_ptr<TokenBucketImpl> impl;
+};
+
+/**
+ * @brief A pair of upload and download rate limits in bytes per second. 0 means unlimited.
+ */
+struct BandwidthLimits {
+	uint64_t uploadBytesPerSecond = 0;
+	uint64_t downloadBytesPerSecond = 0;
+
+	bool operator==(const BandwidthLimits& other) const;
+	bool operator!=(const BandwidthLimits& other) const;
+};
+
+/**
+ * @brief Which limits apply at what time of the week.
+ */
+struct BandwidthSchedule {
+	/**
+	 * @brief The limits during business hours.
+	 */
+	BandwidthLimits businessHours;
+
+	/**
+	 * @brief The limits at every other time.
+	 */
+	BandwidthLimits offHours;
+
+	/**
+	 * @brief The local hour business hours start at, from 0 to 23.
+	 */
+	int businessStartHour = 9;
+
+	/**
+	 * @brief The local hour business hours end at, from 0 to 24. Business hours wrap past midnight if this is less than businessStartHour.
+	 */
+	int businessEndHour = 17;
+
+	/**
+	 * @brief True if Saturdays and Sundays are off-hours all day.
+	 */
+	bool weekendsOff = true;
+
+	/**
+	 * @brief Gets the limits that apply at a point in time, in the local time zone.
+	 */
+	BandwidthLimits limitsAt(std::time_t t) const;
+};
+
+/**
+ * @brief Caps the aggregate upload and download rates of every transfer that goes through it.
+ * The limits follow a schedule, which is re-evaluated every second so that they change on their own when business hours start or end.
+ * This class is thread-safe.
+ */
+class BandwidthLimiter {
+public:
+	/**
+	 * @brief Constructs a BandwidthLimiter.
+	 *
+	 * @param schedule The limits to apply. The default schedule is unlimited.
+	 */
+	BandwidthLimiter(const BandwidthSchedule& schedule = BandwidthSchedule());
+
+	BandwidthLimiter(BandwidthLimiter&& other) noexcept;
+	BandwidthLimiter& operator=(BandwidthLimiter&& other) noexcept;
+	~BandwidthLimiter();
+
+	/**
+	 * @brief Replaces the schedule. The new limits apply immediately.
+	 */
+	void setSchedule(const BandwidthSchedule& schedule);
+
+	/**
+	 * @brief Gets the current schedule.
+	 */
+	BandwidthSchedule getSchedule() const;
+
+	/**
+	 * @brief Gets the limits that apply right now.
+	 */
+	BandwidthLimits getCurrentLimits() const;
+
+	/**
+	 * @brief Blocks until the current limit lets the given number of bytes through in the given direction.
+	 */
+	void acquire(TransferType type, uint64_t bytes);
+
+private:
+	struct BandwidthLimiterImpl;
+	std::unique_ptr<BandwidthLimiterImpl> impl;
+};
+
+}
+
+#endif
@@ -0,0 +1,452 @@
+/** @file baseclient.cpp
+ * @brief Base client class used to connect to a cloud service.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "baseclient.hpp"
+#include "fs/file.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace CloudSync{
+
+/**
+ * @brief The number of removals the default removeRecursive() keeps in flight at once.
+ */
+constexpr size_t REMOVE_PARALLELISM = 8;
+
+BaseClient::BaseClient() = default;
+
+std::optional<std::vector<DirEntry>> BaseClient::readdirPlus(const char* dir){
+	std::optional<std::vector<std::string>> names = readdir(dir);
+	std::vector<DirEntry> ret;
+	std::string base = dir;
+
+	if (!names){
+		return std::nullopt;
+	}
+	if (base.empty() || base.back() != '/'){
+		base += '/';
+	}
+
+	ret.reserve(names->size());
+	for (std::string& name : names.value()){
+		DirEntry entry;
+		if (!stat((base + name).c_str(), &entry.st)){
+			return std::nullopt;
+		}
+		entry.name = std::move(name);
+		ret.push_back(std::move(entry));
+	}
+	return ret;
+}
+
+bool BaseClient::readdirVisit(const char* dir, const ReaddirVisitor& visitor){
+	std::optional<std::vector<std::string>> names = readdir(dir);
+
+	if (!names){
+		return false;
+	}
+	for (const std::string& name : names.value()){
+		if (!visitor(name)){
+			break;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Appends a filename to a cloud directory path.
+ */
+static std::string join_path(const std::string& dir, std::string_view name){
+	std::string ret = dir;
+	if (ret.empty() || ret.back() != '/'){
+		ret += '/';
+	}
+	ret += name;
+	return ret;
+}
+
+/**
+ * @brief Collapses repeated slashes and strips trailing ones, so that cloud paths can be compared.
+ */
+static std::string normalize_path(std::string_view path){
+	std::string ret;
+
+	for (char c : path){
+		if (c == '/' && !ret.empty() && ret.back() == '/'){
+			continue;
+		}
+		ret += c;
+	}
+	while (ret.size() > 1 && ret.back() == '/'){
+		ret.pop_back();
+	}
+	return ret;
+}
+
+/**
+ * @brief Returns true if a normalized path is a directory or somewhere under it.
+ */
+static bool is_within(const std::string& path, const std::string& dir){
+	if (path == dir || dir == "/"){
+		return true;
+	}
+	return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/';
+}
+
+bool BaseClient::copy(const char* src_path, const char* dst_path){
+	struct stat st;
+	struct stat dstSt;
+	std::string dst = dst_path;
+	std::string tmpPath;
+	bool res;
+
+	if (!stat(src_path, &st)){
+		return false;
+	}
+
+	// Copying onto a directory places the source inside of it.
+	if (stat(dst_path, &dstSt)){
+		std::string_view src = src_path;
+		if (!S_ISDIR(dstSt.st_mode)){
+			LOG(LEVEL_DEBUG) << "\"" << dst_path << "\" already exists";
+			return false;
+		}
+		while (src.size() > 1 && src.back() == '/'){
+			src.remove_suffix(1);
+		}
+		dst = join_path(dst, src.substr(src.find_last_of('/') + 1));
+		if (stat(dst.c_str(), &dstSt)){
+			LOG(LEVEL_DEBUG) << "\"" << dst << "\" already exists";
+			return false;
+		}
+	}
+
+	if (S_ISDIR(st.st_mode)){
+		std::optional<std::vector<std::string>> names;
+
+		// The copy would show up in its own listing, and be copied into itself forever.
+		if (is_within(normalize_path(dst), normalize_path(src_path))){
+			LOG(LEVEL_DEBUG) << "Cannot copy \"" << src_path << "\" into itself at \"" << dst << "\"";
+			return false;
+		}
+		if (!mkdir(dst.c_str()) || !(names = readdir(src_path))){
+			return false;
+		}
+		for (const std::string& name : names.value()){
+			if (!copy(join_path(src_path, name).c_str(), join_path(dst, name).c_str())){
+				return false;
+			}
+		}
+		return true;
+	}
+
+	try{
+		// makeTemp() reserves a name, but download() expects its destination not to exist yet.
+		tmpPath = fs::makeTemp().first;
+		fs::remove(tmpPath.c_str());
+	}
+	catch (std::exception& e){
+		LOG(LEVEL_DEBUG) << "Failed to create a temp file: " << e.what();
+		return false;
+	}
+
+	res = download(src_path, tmpPath.c_str()) && upload(tmpPath.c_str(), dst.c_str());
+	fs::remove(tmpPath.c_str());
+	return res;
+}
+
+bool BaseClient::downloadStream(const char* cloud_path, const DownloadSink& sink){
+	std::string tmpPath;
+	bool res = true;
+
+	try{
+		// makeTemp() reserves a name, but download() expects its destination not to exist yet.
+		tmpPath = fs::makeTemp().first;
+		fs::remove(tmpPath.c_str());
+	}
+	catch (std::exception& e){
+		LOG(LEVEL_DEBUG) << "Failed to create a temp file: " << e.what();
+		return false;
+	}
+
+	if (!download(cloud_path, tmpPath.c_str())){
+		fs::remove(tmpPath.c_str());
+		return false;
+	}
+
+	try{
+		std::ifstream ifs(tmpPath, std::ios_base::binary);
+		std::vector<unsigned char> buf(STREAM_CHUNK_LEN);
+
+		while (res && ifs){
+			ifs.read(reinterpret_cast<char*>(buf.data()), buf.size());
+			if (ifs.gcount() > 0){
+				res = sink(buf.data(), ifs.gcount());
+			}
+		}
+		if (ifs.bad()){
+			LOG(LEVEL_DEBUG) << "I/O error reading temp file \"" << tmpPath << "\"";
+			res = false;
+		}
+	}
+	catch (std::exception& e){
+		LOG(LEVEL_DEBUG) << "Failed to stream download of \"" << cloud_path << "\": " << e.what();
+		res = false;
+	}
+
+	fs::remove(tmpPath.c_str());
+	return res;
+}
+
+bool BaseClient::uploadStream(const UploadSource& source, const char* cloud_path){
+	std::string tmpPath;
+	bool res;
+
+	// upload() would place the temp file inside an existing directory instead of failing.
+	if (stat(cloud_path, nullptr)){
+		LOG(LEVEL_DEBUG) << "\"" << cloud_path << "\" already exists";
+		return false;
+	}
+
+	try{
+		std::pair<std::string, std::ofstream> tmpFile = fs::makeTemp();
+		std::vector<unsigned char> buf(STREAM_CHUNK_LEN);
+		size_t len;
+
+		tmpPath = tmpFile.first;
+		while ((len = source(buf.data(), buf.size())) > 0){
+			tmpFile.second.write(reinterpret_cast<const char*>(buf.data()), len);
+		}
+		tmpFile.second.close();
+		if (!tmpFile.second.good()){
+			LOG(LEVEL_DEBUG) << "I/O error writing to temp file \"" << tmpPath << "\"";
+			fs::remove(tmpPath.c_str());
+			return false;
+		}
+	}
+	catch (std::exception& e){
+		LOG(LEVEL_DEBUG) << "Failed to spool upload of \"" << cloud_path << "\": " << e.what();
+		if (!tmpPath.empty()){
+			fs::remove(tmpPath.c_str());
+		}
+		return false;
+	}
+
+	res = upload(tmpPath.c_str(), cloud_path);
+	fs::remove(tmpPath.c_str());
+	return res;
+}
+
+std::future<bool> BaseClient::downloadAsync(const char* cloud_path, const char* disk_path, TransferCallback callback){
+	std::promise<bool> promise;
+	std::future<bool> ret = promise.get_future();
+
+	// The paths are copied because the caller's buffers may not live as long as the transfer.
+	std::thread([this, cloud = std::string(cloud_path), disk = std::string(disk_path), callback, promise = std::move(promise)]() mutable{
+		bool res = download(cloud.c_str(), disk.c_str());
+		if (callback){
+			callback(res);
+		}
+		promise.set_value(res);
+	}).detach();
+
+	return ret;
+}
+
+std::future<bool> BaseClient::uploadAsync(const char* disk_path, const char* cloud_path, TransferCallback callback){
+	std::promise<bool> promise;
+	std::future<bool> ret = promise.get_future();
+
+	std::thread([this, disk = std::string(disk_path), cloud = std::string(cloud_path), callback, promise = std::move(promise)]() mutable{
+		bool res = upload(disk.c_str(), cloud.c_str());
+		if (callback){
+			callback(res);
+		}
+		promise.set_value(res);
+	}).detach();
+
+	return ret;
+}
+
+uint64_t BaseClient::addTransferObserver(TransferObserver observer){
+	std::lock_guard<std::mutex> lock(observerMutex);
+	uint64_t token = nextObserver++;
+
+	observers.emplace(token, std::move(observer));
+	return token;
+}
+
+void BaseClient::removeTransferObserver(uint64_t token){
+	std::lock_guard<std::mutex> lock(observerMutex);
+	observers.erase(token);
+}
+
+void BaseClient::reportCongestion(){
+	std::lock_guard<std::mutex> lock(observerMutex);
+	for (const auto& o : observers){
+		if (o.second.onCongestion){
+			o.second.onCongestion();
+		}
+	}
+}
+
+void BaseClient::reportProgress(uint64_t bytes){
+	if (bytes == 0){
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(observerMutex);
+	for (const auto& o : observers){
+		if (o.second.onProgress){
+			o.second.onProgress(bytes);
+		}
+	}
+}
+
+bool BaseClient::removeRecursive(const char* path, const RemoveProgress& progress){
+	// Every level of the subtree, starting from the path itself.
+	std::vector<std::vector<std::string>> levels = {{ path }};
+	std::vector<std::string> dirs;
+	struct stat st;
+	uint64_t total = 1;
+	uint64_t removed = 0;
+	std::mutex m;
+
+	if (!stat(path, &st)){
+		return false;
+	}
+	if (S_ISDIR(st.st_mode)){
+		dirs.push_back(path);
+	}
+
+	while (!dirs.empty()){
+		std::vector<std::string> nextDirs;
+		std::vector<std::string> level;
+
+		for (const std::string& dir : dirs){
+			std::optional<std::vector<DirEntry>> entries = readdirPlus(dir.c_str());
+			if (!entries){
+				return false;
+			}
+			for (const DirEntry& entry : entries.value()){
+				level.push_back(join_path(dir, entry.name));
+				if (S_ISDIR(entry.st.st_mode)){
+					nextDirs.push_back(level.back());
+				}
+			}
+		}
+
+		total += level.size();
+		levels.push_back(std::move(level));
+		dirs = std::move(nextDirs);
+	}
+
+	// Bottom-up, so every directory is empty by the time it is removed.
+	for (auto level = levels.rbegin(); level != levels.rend(); ++level){
+		std::atomic<size_t> next(0);
+		std::atomic<bool> res(true);
+		std::vector<std::thread> workers;
+
+		auto work = [&]{
+			size_t i;
+			while (res && (i = next++) < level->size()){
+				if (!remove((*level)[i].c_str())){
+					res = false;
+					break;
+				}
+				std::lock_guard<std::mutex> lock(m);
+				removed++;
+				if (progress){
+					progress(removed, total);
+				}
+			}
+		};
+
+		for (size_t i = 1; i < std::min(REMOVE_PARALLELISM, level->size()); ++i){
+			workers.emplace_back(work);
+		}
+		work();
+		for (std::thread& t : workers){
+			t.join();
+		}
+		if (!res){
+			return false;
+		}
+	}
+	return true;
+}
+
+std::vector<std::vector<size_t>> BaseClient::depthWaves(const std::vector<std::string_view>& paths, bool deepestFirst){
+	std::map<size_t, std::vector<size_t>> byDepth;
+	std::vector<std::vector<size_t>> ret;
+
+	for (size_t i = 0; i < paths.size(); ++i){
+		size_t depth = 0;
+		bool inComponent = false;
+		for (char c : paths[i]){
+			if (c != '/' && !inComponent){
+				depth++;
+			}
+			inComponent = c != '/';
+		}
+		byDepth[depth].push_back(i);
+	}
+
+	for (auto& wave : byDepth){
+		ret.push_back(std::move(wave.second));
+	}
+	if (deepestFirst){
+		std::reverse(ret.begin(), ret.end());
+	}
+	return ret;
+}
+
+std::vector<bool> BaseClient::mkdirAll(const std::vector<std::string>& dirs){
+	std::vector<bool> ret(dirs.size(), false);
+	struct stat st;
+
+	for (const auto& wave : depthWaves(std::vector<std::string_view>(dirs.begin(), dirs.end()), false)){
+		for (size_t i : wave){
+			ret[i] = (stat(dirs[i].c_str(), &st) && S_ISDIR(st.st_mode)) || mkdir(dirs[i].c_str());
+		}
+	}
+	return ret;
+}
+
+std::vector<bool> BaseClient::moveMany(const std::vector<std::pair<std::string, std::string>>& moves){
+	std::vector<bool> ret(moves.size(), false);
+	std::vector<std::string_view> sources;
+
+	for (const auto& m : moves){
+		sources.push_back(m.first);
+	}
+	for (const auto& wave : depthWaves(sources, true)){
+		for (size_t i : wave){
+			ret[i] = move(moves[i].first.c_str(), moves[i].second.c_str());
+		}
+	}
+	return ret;
+}
+
+std::vector<bool> BaseClient::removeMany(const std::vector<std::string>& paths){
+	std::vector<bool> ret(paths.size(), false);
+
+	for (const auto& wave : depthWaves(std::vector<std::string_view>(paths.begin(), paths.end()), true)){
+		for (size_t i : wave){
+			ret[i] = remove(paths[i].c_str());
+		}
+	}
+	return ret;
+}
+
+}
@@ -10,12 +10,38 @@
 #define __CS_BASECLIENT_HPP
 
 #include <sys/stat.h>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <optional>
 
 namespace CloudSync{
 
+/**
+ * @brief A directory entry along with its attributes.
+ */
+struct DirEntry{
+	/**
+	 * @brief The filename of the entry.
+	 */
+	std::string name;
+
+	/**
+	 * @brief The attributes of the entry, filled in the same way BaseClient::stat() fills them.
+	 */
+	struct stat st = {};
+
+	/**
+	 * @brief A fingerprint of the entry's contents, or an empty string if the cloud service does not provide one.
+	 */
+	std::string fingerprint;
+};
+
 /**
  * @brief Cloud client abstract superclass.
  * This is used to connect to a cloud service.
@@ -23,6 +49,62 @@ namespace CloudSync{
  */
 class BaseClient{
 public:
+	/**
+	 * @brief A function that is called when an asynchronous transfer finishes.
+	 * Its argument is true if the transfer was successful, false if not.
+	 */
+	using TransferCallback = std::function<void(bool)>;
+
+	/**
+	 * @brief A function that is called once for every filename in a directory.
+	 * The string_view is only valid for the duration of the call.
+	 * Return true to continue the listing, or false to stop it.
+	 */
+	using ReaddirVisitor = std::function<bool(std::string_view)>;
+
+	/**
+	 * @brief A function that fills a buffer with the next chunk of data to upload.
+	 * It returns the number of bytes it wrote, which must be 0 once all of the data has been produced.
+	 * It may throw an exception to abort the upload.
+	 */
+	using UploadSource = std::function<size_t(unsigned char* buf, size_t len)>;
+
+	/**
+	 * @brief A function that receives the next chunk of a download.
+	 * Chunks arrive in order. The buffer is only valid for the duration of the call.
+	 * Return true to continue the download, or false to abort it.
+	 */
+	using DownloadSink = std::function<bool(const unsigned char* buf, size_t len)>;
+
+	/**
+	 * @brief A function that is called when the client notices signs of congestion, such as temporary transfer errors or rate limiting.
+	 * This may be called on a different thread.
+	 */
+	using CongestionCallback = std::function<void()>;
+
+	/**
+	 * @brief A function that is called as transfers move data.
+	 * Its argument is the number of bytes moved since the last call, summed over every transfer of the client.
+	 * This may be called on a different thread.
+	 */
+	using ProgressCallback = std::function<void(uint64_t bytes)>;
+
+	/**
+	 * @brief Functions that are called as the client's transfers progress. Either may be nullptr.
+	 * They are called with the client's observer lock held, so they must not add or remove observers, and should return quickly.
+	 */
+	struct TransferObserver{
+		CongestionCallback onCongestion = nullptr;
+		ProgressCallback onProgress = nullptr;
+	};
+
+	/**
+	 * @brief A function that is called as a recursive remove progresses.
+	 * Its arguments are the number of entries removed so far and the total number of entries to remove.
+	 * This may be called on a different thread, but never by two threads at once.
+	 */
+	using RemoveProgress = std::function<void(uint64_t removed, uint64_t total)>;
+
 	/**
 	 * @brief Logs into the cloud service.
 	 *
@@ -51,6 +133,30 @@ public:
 	 */
 	virtual std::optional<std::vector<std::string>> readdir(const char* dir) = 0;
 
+	/**
+	 * @brief Lists all the entries in a directory along with their attributes.
+	 * The default implementation calls stat() on every entry returned by readdir().
+	 * Subclasses should override this if the cloud service returns the attributes together with the listing.
+	 *
+	 * @param dir The directory to list.
+	 *
+	 * @return A list of entries in the directory, or std::nullopt on error.
+	 */
+	virtual std::optional<std::vector<DirEntry>> readdirPlus(const char* dir);
+
+	/**
+	 * @brief Calls a function on every filename in a directory one at a time, without collecting them first.
+	 * The default implementation iterates over the result of readdir().
+	 * Subclasses should override this so that listing a huge directory does not allocate a string per entry.
+	 *
+	 * @param dir The directory to list.
+	 *
+	 * @param visitor The function to call on every filename.
+	 *
+	 * @return True if the directory was listed, even if the visitor stopped early. False on error.
+	 */
+	virtual bool readdirVisit(const char* dir, const ReaddirVisitor& visitor);
+
 	/**
 	 * @brief Stats a directory/file.
 	 *
@@ -73,6 +179,21 @@ public:
 	 */
 	virtual bool move(const char* old_path, const char* new_path) = 0;
 
+	/**
+	 * @brief Copies a file or directory, recursively.
+	 * Like move(), copying onto an existing directory places the copy inside of it.
+	 * A directory cannot be copied into itself or anywhere under it.
+	 *
+	 * The default implementation downloads every file and uploads it again, so backends that can copy on the server should override it.
+	 *
+	 * @param src_path The file or directory to copy.
+	 *
+	 * @param dst_path The path of the copy, or an existing directory to copy into.
+	 *
+	 * @return True if the copy was successful, false if not. A failed directory copy may leave a partial copy behind.
+	 */
+	virtual bool copy(const char* src_path, const char* dst_path);
+
 	/**
 	 * @brief Downloads a file.
 	 *
@@ -84,6 +205,20 @@ public:
 	 */
 	virtual bool download(const char* cloud_path, const char* disk_path) = 0;
 
+	/**
+	 * @brief Downloads a file, handing its data to a function as it arrives instead of writing it to disk.
+	 * This lets data be decrypted or verified on the fly and written straight to its final location.
+	 * The default implementation downloads to a temporary file and feeds it to the sink afterwards.
+	 * Subclasses should override this if the cloud service can deliver the data as it is received.
+	 *
+	 * @param cloud_path The file to be downloaded.
+	 *
+	 * @param sink The function receiving the data.
+	 *
+	 * @return True if the download was successful and the sink accepted every chunk, false if not.
+	 */
+	virtual bool downloadStream(const char* cloud_path, const DownloadSink& sink);
+
 	/**
 	 * @brief Uploads a file.
 	 *
@@ -95,6 +230,54 @@ public:
 	 */
 	virtual bool upload(const char* disk_path, const char* cloud_path) = 0;
 
+	/**
+	 * @brief Uploads data produced by a function instead of a file on disk.
+	 * This lets data be read, transformed (e.g. encrypted), and uploaded without a full intermediate copy on disk.
+	 * The default implementation spools the data to a temporary file and calls upload().
+	 * Subclasses should override this if the cloud service can consume the data as it is produced.
+	 *
+	 * @param source The function producing the data.
+	 *
+	 * @param cloud_path The full path of the file to create. Unlike upload(), this may not be an existing directory.
+	 *
+	 * @return True if the upload was successful, false if not.
+	 */
+	virtual bool uploadStream(const UploadSource& source, const char* cloud_path);
+
+	/**
+	 * @brief Downloads a file without blocking the caller.
+	 * The default implementation runs download() on its own thread.
+	 * Subclasses should override this if the cloud service can keep several transfers in flight by itself.
+	 * The client must outlive any transfers that are still pending.
+	 *
+	 * @param cloud_path The file to be downloaded.
+	 *
+	 * @param disk_path The location the file should be downloaded to.
+	 *
+	 * @param callback A function to call when the download finishes, or nullptr.
+	 * This may be called on a different thread.
+	 *
+	 * @return A future that becomes true if the download was successful, false if not.
+	 */
+	virtual std::future<bool> downloadAsync(const char* cloud_path, const char* disk_path, TransferCallback callback = nullptr);
+
+	/**
+	 * @brief Uploads a file without blocking the caller.
+	 * The default implementation runs upload() on its own thread.
+	 * Subclasses should override this if the cloud service can keep several transfers in flight by itself.
+	 * The client must outlive any transfers that are still pending.
+	 *
+	 * @param disk_path The file to be uploaded.
+	 *
+	 * @param cloud_path The location the file should be uploaded to.
+	 *
+	 * @param callback A function to call when the upload finishes, or nullptr.
+	 * This may be called on a different thread.
+	 *
+	 * @return A future that becomes true if the upload was successful, false if not.
+	 */
+	virtual std::future<bool> uploadAsync(const char* disk_path, const char* cloud_path, TransferCallback callback = nullptr);
+
 	/**
 	 * @brief Removes a file or empty directory from the cloud.
 	 *
@@ -104,6 +287,20 @@ public:
 	 */
 	virtual bool remove(const char* path) = 0;
 
+	/**
+	 * @brief Removes a file, or a directory along with everything in it.
+	 *
+	 * The default implementation lists the whole subtree and then removes it bottom-up, a level at a time, with several removals in flight at once.
+	 * Backends that can remove a subtree in one request should override it.
+	 *
+	 * @param path The file or directory to remove.
+	 *
+	 * @param progress A function to call as entries are removed, or nullptr.
+	 *
+	 * @return True if everything was removed, false if not. A failed remove may leave part of the subtree behind.
+	 */
+	virtual bool removeRecursive(const char* path, const RemoveProgress& progress = nullptr);
+
 	/**
 	 * @brief Logs out of the cloud service.
 	 *
@@ -111,9 +308,100 @@ public:
 	 */
 	virtual bool logout() = 0;
 
+	/**
+	 * @brief Starts calling an observer as the client's transfers progress.
+	 * Any number of observers can be added, so several users of one client do not displace each other.
+	 * Clients without congestion signals or progress reports simply never call the corresponding function.
+	 *
+	 * @param observer The functions to call.
+	 *
+	 * @return A token to pass to removeTransferObserver().
+	 */
+	uint64_t addTransferObserver(TransferObserver observer);
+
+	/**
+	 * @brief Stops calling an observer.
+	 * Once this returns, the observer is not running and will not be called again.
+	 *
+	 * @param token The token returned by addTransferObserver(). Unknown tokens are ignored.
+	 */
+	void removeTransferObserver(uint64_t token);
+
+	/**
+	 * @brief Creates many directories, parents before children.
+	 * Directories that already exist count as created, so a skeleton can be recreated over a partial one.
+	 * A directory whose parent is neither in the batch nor already in the cloud is not created.
+	 *
+	 * The default implementation creates them one at a time. Backends that can have several requests in flight should override it.
+	 *
+	 * @param dirs The directories to create.
+	 *
+	 * @return Whether each directory was created, in the order they were given.
+	 */
+	virtual std::vector<bool> mkdirAll(const std::vector<std::string>& dirs);
+
+	/**
+	 * @brief Moves many files or directories.
+	 * Deeper sources are moved first, so moving a directory does not invalidate the paths of moves out of it.
+	 *
+	 * The default implementation moves them one at a time. Backends that can have several requests in flight should override it.
+	 *
+	 * @param moves Pairs of old and new paths, with the same meaning as the arguments of move().
+	 *
+	 * @return Whether each move was successful, in the order they were given.
+	 */
+	virtual std::vector<bool> moveMany(const std::vector<std::pair<std::string, std::string>>& moves);
+
+	/**
+	 * @brief Removes many files or empty directories.
+	 * Children are removed before their parents, so a directory can be removed in the same batch as its contents.
+	 *
+	 * The default implementation removes them one at a time. Backends that can have several requests in flight should override it.
+	 *
+	 * @param paths The files or directories to remove.
+	 *
+	 * @return Whether each path was removed, in the order they were given.
+	 */
+	virtual std::vector<bool> removeMany(const std::vector<std::string>& paths);
+
 protected:
+	/**
+	 * @brief The size of the chunks that streamed transfers are moved in.
+	 */
+	static constexpr size_t STREAM_CHUNK_LEN = 65536;
+
 	BaseClient();
+
+	/**
+	 * @brief Groups paths into waves by their depth, so that every path in a wave can be processed at the same time.
+	 * Paths keep their relative order within a wave.
+	 *
+	 * @param paths The paths to group.
+	 * @param deepestFirst True to put the deepest paths in the first wave, false to put the shallowest paths there.
+	 *
+	 * @return The indices of the paths in each wave.
+	 */
+	static std::vector<std::vector<size_t>> depthWaves(const std::vector<std::string_view>& paths, bool deepestFirst);
+
+	/**
+	 * @brief Tells every observer that the client noticed a sign of congestion.
+	 */
+	void reportCongestion();
+
+	/**
+	 * @brief Tells every observer that a transfer moved some bytes.
+	 */
+	void reportProgress(uint64_t bytes);
+
 	virtual ~BaseClient() = default;
+
+private:
+	/**
+	 * @brief The observers by token. observerMutex is held while they run, so none can be called after it was removed.
+	 */
+	std::map<uint64_t, TransferObserver> observers;
+	uint64_t nextObserver = 1;
+	std::mutex observerMutex;
 };
 
 }
@@ -19,6 +19,7 @@
 #include <list>
 #include <memory>
 #include <string>
+#include <string_view>
 
 namespace CloudSync{
 
@@ -63,22 +64,12 @@ struct ConfigFile::ConfigFileImpl {
 	 * @return An iterator to the entry, or entries.end() if the key does not exist within the entries vector.
 	 */
 	auto findEntry(const char* key) {
-		std::string s(key);
-		size_t left = 0;
-		size_t right = entries.size() - 1;
-		while (left <= right) {
-			size_t mid = (left + right) / 2;
-			auto it = entries.begin() + mid;
-
-			if (it->first < s) {
-				left = mid + 1;
-			}
-			else if (it->first > s) {
-				right = mid - 1;
-			}
-			else {
-				return it;
-			}
+		std::string_view s(key);
+		auto it = std::lower_bound(entries.begin(), entries.end(), s, [](const auto& elem, std::string_view k) {
+			return elem.first < k;
+		});
+		if (it != entries.end() && it->first == s) {
+			return it;
 		}
 		return entries.end();
 	}
@@ -251,6 +242,7 @@ bool ConfigFile::removeEntry(const char* key) noexcept {
 		return false;
 	}
 	this->impl->entries.erase(it);
+	this->impl->pending = true;
 	return true;
 }
 
@@ -12,9 +12,12 @@
 #include "notfoundexception.hpp"
 #include "../lnthrow.hpp"
 #include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace CloudSync::fs {
 
@@ -214,4 +217,18 @@ std::string parentDir(const char* dir) {
 	return std::filesystem::path(dir).parent_path().generic_u8string();
 }
 
+void sync(const char* path) {
+	// fsync() works on a read-only descriptor, which is also the only kind a directory can be opened with.
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		lnthrow(IOException, std::string("Failed to open \"") + path + "\" for syncing (" + std::strerror(errno) + ")");
+	}
+	if (fsync(fd) != 0) {
+		int err = errno;
+		close(fd);
+		lnthrow(IOException, std::string("Failed to sync \"") + path + "\" (" + std::strerror(err) + ")");
+	}
+	close(fd);
+}
+
 }
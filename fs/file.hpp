@@ -170,6 +170,16 @@ std::pair<std::string, std::ofstream> makeTemp(const char* baseDir = nullptr);
  */
 std::string parentDir(const char* dir);
 
+/**
+ * @brief Flushes a file or directory to disk with fsync().
+ * Syncing a directory makes the entries created, renamed, or removed in it durable.
+ *
+ * @param path The file or directory to sync.
+ *
+ * @exception IOException I/O error.
+ */
+void sync(const char* path);
+
 }
 
 #endif
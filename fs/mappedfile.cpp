@@ -0,0 +1,85 @@
+/** @file mappedfile.cpp
+ * @brief Maps a file into memory read-only.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "mappedfile.hpp"
+#include "ioexception.hpp"
+#include "notfoundexception.hpp"
+#include "../lnthrow.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace CloudSync::fs {
+
+MappedFile::MappedFile(const char* path) {
+	struct stat st;
+	int fd;
+	void* mem;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		if (errno == ENOENT) {
+			lnthrow(NotFoundException, std::string("\"") + path + "\" does not exist.");
+		}
+		lnthrow(IOException, std::string("Failed to open \"") + path + "\" (" + std::strerror(errno) + ")");
+	}
+	if (fstat(fd, &st) != 0) {
+		std::string err = std::strerror(errno);
+		close(fd);
+		lnthrow(IOException, std::string("Failed to stat \"") + path + "\" (" + err + ")");
+	}
+
+	// mmap() rejects a length of 0.
+	if (st.st_size == 0) {
+		close(fd);
+		return;
+	}
+
+	mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping holds its own reference to the file.
+	close(fd);
+	if (mem == MAP_FAILED) {
+		lnthrow(IOException, std::string("Failed to map \"") + path + "\" (" + std::strerror(errno) + ")");
+	}
+	this->ptr = static_cast<const unsigned char*>(mem);
+	this->len = st.st_size;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept: ptr(std::exchange(other.ptr, nullptr)), len(std::exchange(other.len, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		if (this->ptr) {
+			munmap(const_cast<unsigned char*>(this->ptr), this->len);
+		}
+		this->ptr = std::exchange(other.ptr, nullptr);
+		this->len = std::exchange(other.len, 0);
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile() {
+	if (this->ptr) {
+		munmap(const_cast<unsigned char*>(this->ptr), this->len);
+	}
+}
+
+const unsigned char* MappedFile::data() const noexcept {
+	return this->ptr;
+}
+
+size_t MappedFile::size() const noexcept {
+	return this->len;
+}
+
+}
@@ -0,0 +1,57 @@
+/** @file mappedfile.hpp
+ * @brief Maps a file into memory read-only.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#ifndef __CS_MAPPEDFILE_HPP
+#define __CS_MAPPEDFILE_HPP
+
+#include <cstddef>
+
+namespace CloudSync::fs {
+
+/**
+ * @brief A read-only memory mapping of a whole file.
+ * Pages are only read from the disk when they are first touched, so opening even a huge file is instant.
+ * The mapping is private, so changes made to the file afterwards may or may not be visible through it; replace such files with a rename instead of rewriting them in place.
+ */
+class MappedFile {
+public:
+	/**
+	 * @brief Maps a file into memory.
+	 *
+	 * @param path The file to map.
+	 *
+	 * @exception NotFoundException The file does not exist.
+	 * @exception IOException The file could not be opened or mapped.
+	 */
+	MappedFile(const char* path);
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile& operator=(const MappedFile& other) = delete;
+	~MappedFile();
+
+	/**
+	 * @brief Returns the contents of the file, or nullptr if the file is empty.
+	 * The pointer is page-aligned.
+	 */
+	const unsigned char* data() const noexcept;
+
+	/**
+	 * @brief Returns the size of the file in bytes.
+	 */
+	size_t size() const noexcept;
+
+private:
+	const unsigned char* ptr = nullptr;
+	size_t len = 0;
+};
+
+}
+
+#endif
@@ -22,15 +22,17 @@ struct TreeWalker::TreeWalkerImpl {
 	std::filesystem::recursive_directory_iterator iter;
 	std::mutex m;
 	std::filesystem::path currentPath;
+	bool includeDirectories;
 	const std::filesystem::recursive_directory_iterator end;
 };
 
-TreeWalker::TreeWalker(const char* baseDir): impl(std::make_unique<TreeWalkerImpl>()) {
+TreeWalker::TreeWalker(const char* baseDir, bool includeDirectories): impl(std::make_unique<TreeWalkerImpl>()) {
 	if (!isDirectory(baseDir)) {
 		lnthrow(NotFoundException, "\"" + std::string(baseDir) + "\" does not point to a directory");
 	}
 
 	this->impl->baseDir = baseDir;
+	this->impl->includeDirectories = includeDirectories;
 	try {
 		this->impl->iter = std::filesystem::recursive_directory_iterator(this->impl->baseDir, std::filesystem::directory_options::skip_permission_denied);
 	}
@@ -47,7 +49,7 @@ const char* TreeWalker::nextEntry() {
 		return nullptr;
 	}
 	this->impl->currentPath = this->impl->iter->path();
-	if (std::filesystem::is_directory(this->impl->currentPath.generic_string())) {
+	if (!this->impl->includeDirectories && std::filesystem::is_directory(this->impl->currentPath.generic_string())) {
 		++this->impl->iter;
 		lock.unlock();
 		return nextEntry();
@@ -22,11 +22,12 @@ public:
 	 * @brief Constructs a TreeWalker class starting at the specified directory.
 	 *
 	 * @param baseDir The base directory to start iterating through.
+	 * @param includeDirectories Return directories from nextEntry() too, each one before its contents, instead of only the files in them.
 	 *
 	 * @exception NotFoundException A directory does not exist at this path.
 	 * @exception IOException I/O error.
 	 */
-	TreeWalker(const char* baseDir);
+	TreeWalker(const char* baseDir, bool includeDirectories = false);
 
 	/**
 	 * @brief We have to explicitly define the destructor, otherwise the pImpl unique_ptr has errors determining how to delete the TreeWalkerImpl.
@@ -0,0 +1,420 @@
+/** @file localdirclient.cpp
+ * @brief Client that stores its "cloud" in a local directory.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "localdirclient.hpp"
+#include "fs/file.hpp"
+#include "logger.hpp"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sys/stat.h>
+
+namespace CloudSync{
+
+struct LocalDirClient::LocalDirClientImpl{
+	/**
+	 * @brief The directory that holds the "cloud".
+	 */
+	std::filesystem::path baseDir;
+
+	/**
+	 * @brief A description of the last error.
+	 */
+	std::string lastError;
+	bool hasError = false;
+	std::mutex errorMutex;
+
+	/**
+	 * @brief Converts a cloud path to the path on disk that backs it.
+	 *
+	 * @return The disk path, or std::nullopt if the cloud path is not absolute or would escape the base directory.
+	 */
+	std::optional<std::filesystem::path> toDisk(const char* cloudPath){
+		std::filesystem::path p(cloudPath);
+
+		if (!p.is_absolute()){
+			setError(std::string("\"") + cloudPath + "\" is not an absolute path");
+			return std::nullopt;
+		}
+		for (const auto& component : p){
+			if (component == ".."){
+				setError(std::string("\"") + cloudPath + "\" may not contain \"..\"");
+				return std::nullopt;
+			}
+		}
+		return baseDir / p.relative_path();
+	}
+
+	void setError(const std::string& msg){
+		std::lock_guard<std::mutex> lock(errorMutex);
+		lastError = msg;
+		hasError = true;
+		LOG(LEVEL_DEBUG) << "LocalDirClient: " << msg;
+	}
+};
+
+LocalDirClient::LocalDirClient(const char* baseDir): impl(std::make_unique<LocalDirClientImpl>()){
+	impl->baseDir = baseDir;
+}
+
+LocalDirClient::~LocalDirClient() = default;
+
+bool LocalDirClient::login(const char* username, const char* password){
+	(void)username;
+	(void)password;
+
+	try{
+		fs::createDirectory(impl->baseDir.c_str());
+	}
+	catch (std::exception& e){
+		impl->setError(e.what());
+		return false;
+	}
+	return true;
+}
+
+bool LocalDirClient::mkdir(const char* dir){
+	std::optional<std::filesystem::path> path = impl->toDisk(dir);
+
+	if (!path){
+		return false;
+	}
+
+	try{
+		if (fs::exists(path->c_str())){
+			impl->setError(std::string("\"") + dir + "\" already exists");
+			return false;
+		}
+		// Unlike fs::createDirectory(), the cloud clients do not create missing parents.
+		if (!fs::isDirectory(path->parent_path().c_str())){
+			impl->setError(std::string("The parent of \"") + dir + "\" is not a directory");
+			return false;
+		}
+		fs::createDirectory(path->c_str());
+	}
+	catch (std::exception& e){
+		impl->setError(e.what());
+		return false;
+	}
+	return true;
+}
+
+std::optional<std::vector<std::string>> LocalDirClient::readdir(const char* dir){
+	std::optional<std::filesystem::path> path = impl->toDisk(dir);
+	std::vector<std::string> ret;
+
+	if (!path){
+		return std::nullopt;
+	}
+
+	try{
+		for (const auto& entry : std::filesystem::directory_iterator(path.value())){
+			ret.push_back(entry.path().filename().string());
+		}
+	}
+	catch (std::filesystem::filesystem_error& e){
+		impl->setError(e.what());
+		return std::nullopt;
+	}
+	return ret;
+}
+
+bool LocalDirClient::readdirVisit(const char* dir, const ReaddirVisitor& visitor){
+	std::optional<std::filesystem::path> path = impl->toDisk(dir);
+
+	if (!path){
+		return false;
+	}
+
+	try{
+		for (const auto& entry : std::filesystem::directory_iterator(path.value())){
+			std::filesystem::path filename = entry.path().filename();
+			if (!visitor(filename.native())){
+				break;
+			}
+		}
+	}
+	catch (std::filesystem::filesystem_error& e){
+		impl->setError(e.what());
+		return false;
+	}
+	return true;
+}
+
+bool LocalDirClient::stat(const char* path, struct stat* st){
+	std::optional<std::filesystem::path> diskPath = impl->toDisk(path);
+	struct stat tmp;
+
+	if (!diskPath){
+		return false;
+	}
+	if (::stat(diskPath->c_str(), st ? st : &tmp) != 0){
+		impl->setError(std::string("Failed to stat \"") + path + "\" (" + std::strerror(errno) + ")");
+		return false;
+	}
+	return true;
+}
+
+bool LocalDirClient::move(const char* old_path, const char* new_path){
+	std::optional<std::filesystem::path> src = impl->toDisk(old_path);
+	std::optional<std::filesystem::path> dst = impl->toDisk(new_path);
+
+	if (!src || !dst){
+		return false;
+	}
+
+	try{
+		if (!fs::exists(src->c_str())){
+			impl->setError(std::string("\"") + old_path + "\" does not exist");
+			return false;
+		}
+		// Moving onto a directory places the source inside of it.
+		if (fs::isDirectory(dst->c_str())){
+			dst.value() /= src->filename();
+		}
+		fs::move(src->c_str(), dst->c_str());
+	}
+	catch (std::exception& e){
+		impl->setError(e.what());
+		return false;
+	}
+	return true;
+}
+
+bool LocalDirClient::copy(const char* src_path, const char* dst_path){
+	std::optional<std::filesystem::path> src = impl->toDisk(src_path);
+	std::optional<std::filesystem::path> dst = impl->toDisk(dst_path);
+
+	if (!src || !dst){
+		return false;
+	}
+
+	try{
+		if (!fs::exists(src->c_str())){
+			impl->setError(std::string("\"") + src_path + "\" does not exist");
+			return false;
+		}
+		// Copying onto a directory places the copy inside of it.
+		if (fs::isDirectory(dst->c_str())){
+			dst.value() /= src->filename();
+		}
+		if (fs::exists(dst->c_str())){
+			impl->setError(std::string("\"") + dst->string() + "\" already exists");
+			return false;
+		}
+		std::filesystem::path rel = dst->lexically_normal().lexically_relative(src->lexically_normal());
+		if (fs::isDirectory(src->c_str()) && !rel.empty() && *rel.begin() != ".."){
+			impl->setError(std::string("Cannot copy \"") + src_path + "\" into itself");
+			return false;
+		}
+		std::filesystem::copy(src.value(), dst.value(), std::filesystem::copy_options::recursive);
+	}
+	catch (std::exception& e){
+		impl->setError(e.what());
+		return false;
+	}
+	return true;
+}
+
+bool LocalDirClient::download(const char* cloud_path, const char* disk_path){
+	std::optional<std::filesystem::path> src = impl->toDisk(cloud_path);
+
+	if (!src){
+		return false;
+	}
+
+	try{
+		if (!fs::isFile(src->c_str())){
+			impl->setError(std::string("\"") + cloud_path + "\" is not a file");
+			return false;
+		}
+		fs::copy(src->c_str(), disk_path);
+		reportProgress(fs::size(disk_path));
+	}
+	catch (std::exception& e){
+		impl->setError(e.what());
+		return false;
+	}
+	return true;
+}
+
+bool LocalDirClient::downloadStream(const char* cloud_path, const DownloadSink& sink){
+	std::optional<std::filesystem::path> src = impl->toDisk(cloud_path);
+
+	if (!src){
+		return false;
+	}
+
+	try{
+		if (!fs::isFile(src->c_str())){
+			impl->setError(std::string("\"") + cloud_path + "\" is not a file");
+			return false;
+		}
+
+		std::ifstream ifs(src.value(), std::ios_base::binary);
+		unsigned char buf[STREAM_CHUNK_LEN];
+
+		while (ifs){
+			ifs.read(reinterpret_cast<char*>(buf), sizeof(buf));
+			reportProgress(ifs.gcount());
+			if (ifs.gcount() > 0 && !sink(buf, ifs.gcount())){
+				impl->setError(std::string("The download of \"") + cloud_path + "\" was aborted");
+				return false;
+			}
+		}
+		if (ifs.bad()){
+			impl->setError(std::string("I/O error reading \"") + cloud_path + "\"");
+			return false;
+		}
+	}
+	catch (std::exception& e){
+		impl->setError(e.what());
+		return false;
+	}
+	return true;
+}
+
+bool LocalDirClient::upload(const char* disk_path, const char* cloud_path){
+	std::optional<std::filesystem::path> dst = impl->toDisk(cloud_path);
+
+	if (!dst){
+		return false;
+	}
+
+	try{
+		// Uploading to an existing folder keeps the disk filename.
+		if (fs::isDirectory(dst->c_str())){
+			dst.value() /= std::filesystem::path(disk_path).filename();
+		}
+		if (!fs::isDirectory(dst->parent_path().c_str())){
+			impl->setError(std::string("The parent of \"") + cloud_path + "\" does not exist");
+			return false;
+		}
+		fs::copy(disk_path, dst->c_str());
+		reportProgress(fs::size(dst->c_str()));
+	}
+	catch (std::exception& e){
+		impl->setError(e.what());
+		return false;
+	}
+	return true;
+}
+
+bool LocalDirClient::uploadStream(const UploadSource& source, const char* cloud_path){
+	std::optional<std::filesystem::path> dst = impl->toDisk(cloud_path);
+	std::string tmpPath;
+
+	if (!dst){
+		return false;
+	}
+
+	try{
+		if (fs::exists(dst->c_str())){
+			impl->setError(std::string("\"") + cloud_path + "\" already exists");
+			return false;
+		}
+		if (!fs::isDirectory(dst->parent_path().c_str())){
+			impl->setError(std::string("The parent of \"") + cloud_path + "\" does not exist");
+			return false;
+		}
+
+		// The data is written next to its destination so the final move is a rename, not a copy.
+		std::pair<std::string, std::ofstream> tmpFile = fs::makeTemp(dst->parent_path().c_str());
+		unsigned char buf[STREAM_CHUNK_LEN];
+		size_t len;
+
+		tmpPath = tmpFile.first;
+		while ((len = source(buf, sizeof(buf))) > 0){
+			tmpFile.second.write(reinterpret_cast<const char*>(buf), len);
+			reportProgress(len);
+		}
+		tmpFile.second.close();
+		if (!tmpFile.second.good()){
+			impl->setError(std::string("I/O error writing to \"") + tmpPath + "\"");
+			fs::remove(tmpPath.c_str());
+			return false;
+		}
+		fs::move(tmpPath.c_str(), dst->c_str());
+	}
+	catch (std::exception& e){
+		impl->setError(e.what());
+		if (!tmpPath.empty()){
+			fs::remove(tmpPath.c_str());
+		}
+		return false;
+	}
+	return true;
+}
+
+bool LocalDirClient::remove(const char* path){
+	std::optional<std::filesystem::path> diskPath = impl->toDisk(path);
+
+	if (!diskPath){
+		return false;
+	}
+
+	try{
+		if (fs::isDirectory(diskPath->c_str()) && !std::filesystem::is_empty(diskPath.value())){
+			impl->setError(std::string("\"") + path + "\" is not empty");
+			return false;
+		}
+		if (!fs::remove(diskPath->c_str())){
+			impl->setError(std::string("\"") + path + "\" does not exist");
+			return false;
+		}
+	}
+	catch (std::exception& e){
+		impl->setError(e.what());
+		return false;
+	}
+	return true;
+}
+
+bool LocalDirClient::removeRecursive(const char* path, const RemoveProgress& progress){
+	std::optional<std::filesystem::path> diskPath = impl->toDisk(path);
+	std::uintmax_t count;
+
+	if (!diskPath){
+		return false;
+	}
+	// Removing the root would remove the base directory itself.
+	std::filesystem::path relative = std::filesystem::path(path).relative_path().lexically_normal();
+	if (relative.empty() || relative == "."){
+		impl->setError("The root directory cannot be removed");
+		return false;
+	}
+
+	try{
+		count = std::filesystem::remove_all(diskPath.value());
+		if (count == 0){
+			impl->setError(std::string("\"") + path + "\" does not exist");
+			return false;
+		}
+	}
+	catch (std::exception& e){
+		impl->setError(e.what());
+		return false;
+	}
+	if (progress){
+		progress(count, count);
+	}
+	return true;
+}
+
+bool LocalDirClient::logout(){
+	return true;
+}
+
+const char* LocalDirClient::getLastError(){
+	std::lock_guard<std::mutex> lock(impl->errorMutex);
+	return impl->hasError ? impl->lastError.c_str() : nullptr;
+}
+
+}
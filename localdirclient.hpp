@@ -0,0 +1,65 @@
+/** @file localdirclient.hpp
+ * @brief Client that stores its "cloud" in a local directory.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#ifndef __CS_LOCALDIRCLIENT_HPP
+#define __CS_LOCALDIRCLIENT_HPP
+
+#include "baseclient.hpp"
+#include <memory>
+
+namespace CloudSync{
+
+/**
+ * @brief A BaseClient that maps cloud paths onto a directory on disk.
+ * A cloud path of "/a/b" refers to "<baseDir>/a/b".
+ * This needs no network access or account, which makes it suitable for tests and reproducible benchmarks.
+ * It follows the same semantics as the MegaClient, so code tested against it behaves the same against the real service.
+ */
+class LocalDirClient final : public BaseClient{
+public:
+	/**
+	 * @brief Constructs a LocalDirClient.
+	 *
+	 * @param baseDir The directory that holds the "cloud".
+	 * It is created by login() if it does not exist.
+	 */
+	LocalDirClient(const char* baseDir);
+	~LocalDirClient();
+
+	/**
+	 * @brief Makes sure the base directory exists.
+	 * The username and password are ignored.
+	 */
+	virtual bool login(const char* username, const char* password) override;
+	virtual bool mkdir(const char* dir) override;
+	virtual std::optional<std::vector<std::string>> readdir(const char* dir) override;
+	virtual bool readdirVisit(const char* dir, const ReaddirVisitor& visitor) override;
+	virtual bool stat(const char* path, struct stat* st) override;
+	virtual bool move(const char* oldPath, const char* newPath) override;
+	virtual bool copy(const char* srcPath, const char* dstPath) override;
+	virtual bool download(const char* cloudPath, const char* diskPath) override;
+	virtual bool downloadStream(const char* cloudPath, const DownloadSink& sink) override;
+	virtual bool upload(const char* diskPath, const char* cloudPath) override;
+	virtual bool uploadStream(const UploadSource& source, const char* cloudPath) override;
+	virtual bool remove(const char* path) override;
+	virtual bool removeRecursive(const char* path, const RemoveProgress& progress = nullptr) override;
+	virtual bool logout() override;
+
+	/**
+	 * @brief Gets a description of the last error, or nullptr if there has not been one.
+	 */
+	const char* getLastError();
+
+private:
+	struct LocalDirClientImpl;
+	std::unique_ptr<LocalDirClientImpl> impl;
+};
+
+}
+
+#endif
@@ -8,24 +8,42 @@
 
 #include "attribute.hpp"
 #include "megaclient.hpp"
+#include "fs/file.hpp"
 #include "keys.hpp"
 #include "logger.hpp"
 #include "progressbar.hpp"
 #include "sdk/mega_sdk/include/megaapi.h"
 
 #include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
 #include <unistd.h>
 #include <mutex>
 #include <condition_variable>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <numeric>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 
 namespace CloudSync{
 
 class MegaClientError{
 public:
-	MegaClientError(): mcec(NO_ERROR), apiError(nullptr) {}
+	MegaClientError(): mcec(NO_ERROR) {}
 
+	/**
+	 * @brief Describes the error. The string stays valid until the next call to setError() or toString().
+	 */
 	const char* toString(){
+		std::lock_guard<std::mutex> lock(m);
 		switch (mcec){
 		case NO_ERROR:
 			return nullptr;
@@ -41,16 +59,14 @@ public:
 			return "The path specifies a directory";
 		case PATH_NOT_FOUND:
 			return "The path does not exist";
+		case SESSION_NOT_FOUND:
+			return "No saved session was found";
 		case REQUEST_ERROR:
-			if (!apiError){
-				return "Unknown request error. This should never happen";
-			}
-			return std::string(std::string("Request error: ") + apiError).c_str();
+			message = "Request error: " + apiError;
+			return message.c_str();
 		case TRANSFER_ERROR:
-			if (!apiError){
-				return "Unknown transfer error. This should never happen";
-			}
-			return std::string(std::string("Transfer error: ") + apiError).c_str();
+			message = "Transfer error: " + apiError;
+			return message.c_str();
 		case SHOULDNEVERHAPPEN_ERROR:
 			return "This should never happen.";
 		}
@@ -58,32 +74,386 @@ public:
 	}
 
 	MegaClientErrorCode getErrorCode(){
+		std::lock_guard<std::mutex> lock(m);
 		return mcec;
 	}
 
+	/**
+	 * @brief Gets the SDK's description of the error, or nullptr if there is none. The string stays valid until the next call to setError().
+	 */
 	const char* getApiError(){
-		return apiError;
+		std::lock_guard<std::mutex> lock(m);
+		return apiError.empty() ? nullptr : apiError.c_str();
 	}
 
+	/**
+	 * @brief Sets the error. The SDK's description is copied, so it may be a temporary.
+	 */
 	void setError(MegaClientErrorCode mcec, const char* apiError = nullptr){
-		this->mcec = mcec;
 		if ((mcec == REQUEST_ERROR || mcec == TRANSFER_ERROR) &&
 				apiError == nullptr){
 			throw std::invalid_argument("mcec was REQUEST_ERROR or TRANSFER_ERROR, but apiError was not specified");
 		}
-		this->apiError = apiError;
+		std::lock_guard<std::mutex> lock(m);
+		this->mcec = mcec;
+		this->apiError = apiError ? apiError : "";
 	}
 
 private:
 	enum MegaClientErrorCode mcec;
-	const char* apiError;
+	std::string apiError;
+	/**
+	 * @brief Holds the string returned by toString() when it has to be built.
+	 */
+	std::string message;
+	// Asynchronous transfers report their errors from the SDK's thread.
+	std::mutex m;
+};
+
+/**
+ * @brief Watches every transfer of a session for progress and for temporary errors, which is how the SDK reports that a transfer is being throttled or the link is overloaded.
+ */
+class ObserverTransferListener : public mega::MegaTransferListener{
+public:
+	ObserverTransferListener(std::function<void()> onCongestion, std::function<void(uint64_t)> onProgress): onCongestion(std::move(onCongestion)), onProgress(std::move(onProgress)){}
+
+	void onTransferUpdate(mega::MegaApi* mega_api, mega::MegaTransfer* transfer){
+		(void)mega_api;
+		if (transfer->getDeltaSize() > 0){
+			onProgress(transfer->getDeltaSize());
+		}
+	}
+
+	void onTransferTemporaryError(mega::MegaApi* mega_api, mega::MegaTransfer* transfer, mega::MegaError* error){
+		(void)mega_api;
+		(void)transfer;
+		(void)error;
+		onCongestion();
+	}
+
+private:
+	std::function<void()> onCongestion;
+	std::function<void(uint64_t)> onProgress;
 };
 
 struct MegaClient::MegaClientImpl{
+	MegaClientImpl(MegaClient& client): client(client){}
+
+	/**
+	 * @brief The client this belongs to, which reports to the transfer observers.
+	 */
+	MegaClient& client;
+
+	/**
+	 * @brief Reports a sign of congestion to the transfer observers.
+	 */
+	void congested(){
+		client.reportCongestion();
+	}
+
+	/**
+	 * @brief Registered with every MegaApi instance. This is declared before mapi so that it outlives it.
+	 */
+	ObserverTransferListener observerListener{[this]{ congested(); }, [this](uint64_t bytes){ client.reportProgress(bytes); }};
+
 	const char* uploadMsg = nullptr;
 	const char* downloadMsg = nullptr;
 	std::unique_ptr<mega::MegaApi> mapi = nullptr;
 	MegaClientError lastError;
+
+	/**
+	 * @brief The directory the SDK keeps its local node database in, or empty for none.
+	 */
+	std::string cacheDir;
+
+	/**
+	 * @brief True if the session has been saved with saveSession(), so it must not be invalidated on destruction.
+	 */
+	bool sessionSaved = false;
+
+	/**
+	 * @brief Files at least this large are downloaded in rangedDownloadCount concurrent ranges.
+	 */
+	uint64_t rangedDownloadMin = 0;
+	int rangedDownloadCount = 1;
+
+	/**
+	 * @brief The journal transfers record their progress in, or nullptr for none.
+	 */
+	TransferJournal* journal = nullptr;
+
+	/**
+	 * @brief Downloads a file as byte ranges in parallel, writing each into place in a preallocated file.
+	 * If the journal holds the progress of an earlier attempt at the same download, only the missing bytes are fetched.
+	 * Ranges that fail are retried from where they stopped according to the retry policy.
+	 *
+	 * @param node The file to download.
+	 * @param cloud_path The path of the file, which identifies the download in the journal.
+	 * @param disk_path The location the file should be downloaded to.
+	 * @param nRanges The number of ranges to split the file into when starting from scratch.
+	 *
+	 * @return True if the download was successful, false if not.
+	 */
+	bool downloadRanges(mega::MegaNode* node, const char* cloud_path, const char* disk_path, int nRanges);
+
+	/**
+	 * @brief True if uploads look for a file with the same fingerprint in the account first.
+	 */
+	bool fingerprintSkip = true;
+
+	/**
+	 * @brief Places a file in the cloud without uploading it, if a file with the same content is already in the account.
+	 * A file with the same fingerprint under the target name is left as is, and one anywhere else is copied server-side.
+	 *
+	 * @param disk_path The file to be uploaded.
+	 * @param parent The folder the file is being uploaded to.
+	 * @param name The name the file is being uploaded under, or std::nullopt to keep its disk filename.
+	 *
+	 * @return True if the file is in place, false if it still has to be uploaded.
+	 */
+	bool placeByFingerprint(const char* disk_path, mega::MegaNode* parent, const std::optional<std::string>& name);
+
+	/**
+	 * @brief Writes a record to the journal and flushes it.
+	 * A journal that cannot be written only costs the ability to resume, so errors are logged instead of thrown.
+	 *
+	 * @param record The record to write.
+	 * @param fd The file being downloaded into, or -1 for none.
+	 * Its data is synced to disk first, so the journal never marks a range as done whose bytes could still be lost in a crash.
+	 */
+	void checkpoint(const TransferRecord& record, int fd = -1);
+
+	/**
+	 * @brief Removes a finished transfer from the journal, if one is set.
+	 */
+	void forget(TransferType type, const char* disk_path, const char* cloud_path);
+
+	/**
+	 * @brief The adaptive timeout of each kind of request.
+	 */
+	std::array<AdaptiveTimeout, static_cast<size_t>(MegaRequestType::Count)> timeouts = {
+		AdaptiveTimeout(MEGA_WAIT_MS),
+		// Fetching the nodes of a large account takes minutes.
+		AdaptiveTimeout(MEGA_WAIT_MS * 6, 1000, 600000),
+		AdaptiveTimeout(MEGA_WAIT_MS),
+		AdaptiveTimeout(MEGA_WAIT_MS),
+		// Copying a large folder happens entirely on the server, but it still takes a while.
+		AdaptiveTimeout(MEGA_WAIT_MS * 6, 1000, 600000),
+		AdaptiveTimeout(MEGA_WAIT_MS),
+		AdaptiveTimeout(MEGA_WAIT_MS),
+	};
+
+	/**
+	 * @brief True once the latencies saved in the cache directory by an earlier session have been recorded.
+	 */
+	bool latenciesLoaded = false;
+
+	/**
+	 * @brief Records the latencies saved by an earlier session, so requests made once per session such as the login still get adaptive timeouts.
+	 * This does nothing without a cache directory, or after the first time.
+	 */
+	void loadLatencies();
+
+	/**
+	 * @brief Saves the latencies measured so far to the cache directory, if there is one.
+	 */
+	void saveLatencies();
+
+	/**
+	 * @brief Fixed timeouts that override the adaptive ones, or 0 for none.
+	 */
+	std::array<int, static_cast<size_t>(MegaRequestType::Count)> timeoutOverrides = {};
+
+	RetryPolicy retryPolicy;
+
+	/**
+	 * @brief Sends a request and waits for it to finish, with a timeout derived from the latencies measured so far.
+	 * Requests failing with a temporary error are retried with exponential backoff.
+	 * A request that times out is never sent again, as it may still be pending. Instead, the SDK is told to retry its connections and the request is waited on again, as often as the retry policy allows.
+	 *
+	 * @param type The kind of request.
+	 * @param send A function that sends the request using the listener it is given.
+	 * @param handle Set to the node handle of the finished request if not nullptr.
+	 *
+	 * @return True if the request was successful. False if not, in which case lastError is set.
+	 */
+	bool runRequest(MegaRequestType type, const std::function<void(mega::MegaRequestListener*)>& send, mega::MegaHandle* handle = nullptr);
+
+	/**
+	 * @brief Sends many requests of the same kind with up to MEGA_PIPELINE_DEPTH of them in flight at once, and waits for all of them to finish.
+	 * Failures are handled like in runRequest(), and lastError is set to the last of them.
+	 *
+	 * @param type The kind of request.
+	 * @param sends Functions that each send one request using the listener they are given.
+	 * @param handles Set to the node handle of each finished request if not nullptr.
+	 *
+	 * @return Whether each request was successful.
+	 */
+	std::vector<bool> runRequests(MegaRequestType type, const std::vector<std::function<void(mega::MegaRequestListener*)>>& sends, std::vector<mega::MegaHandle>* handles = nullptr);
+
+	/**
+	 * @brief A metadata request that has been checked and is ready to be sent.
+	 */
+	struct PreparedRequest{
+		/**
+		 * @brief Sends the request using the listener it is given.
+		 */
+		std::function<void(mega::MegaRequestListener*)> send;
+		/**
+		 * @brief Updates the node cache once the request succeeds. Its argument is the node handle of the request.
+		 */
+		std::function<void(mega::MegaHandle)> onSuccess;
+	};
+
+	/**
+	 * @brief Checks an operation and builds the request that carries it out.
+	 *
+	 * @return The request, or std::nullopt if the operation cannot be carried out, in which case lastError is set.
+	 */
+	std::optional<PreparedRequest> prepareMkdir(const char* dir);
+	std::optional<PreparedRequest> prepareMove(const char* old_path, const char* new_path);
+	std::optional<PreparedRequest> prepareRemove(const char* path);
+
+	/**
+	 * @brief Sends prepared requests in a pipeline and records which of them succeeded.
+	 *
+	 * @param type The kind of the requests.
+	 * @param requests The requests to send.
+	 * @param indices The index in ret that each request's result goes into.
+	 * @param ret Set to true at the index of each request that succeeded.
+	 */
+	void runPrepared(MegaRequestType type, std::vector<PreparedRequest>& requests, const std::vector<size_t>& indices, std::vector<bool>& ret);
+
+	/**
+	 * @brief Creates the MegaApi instance, along with the cache directory if one was given.
+	 */
+	void createApi();
+
+	/**
+	 * @brief Logs in, fetches the account's nodes, and tears down the MegaApi instance on failure.
+	 *
+	 * @param send A function that sends the login request using the listener it is given.
+	 *
+	 * @return True if the login and fetch were successful, false if not.
+	 */
+	bool finishLogin(const std::function<void(mega::MegaRequestListener*)>& send);
+
+	/**
+	 * @brief Drops the MegaApi instance and everything tied to its session.
+	 */
+	void reset();
+
+	/**
+	 * @brief The limiter whose limits are applied to the SDK, or nullptr for none.
+	 */
+	BandwidthLimiter* limiter = nullptr;
+
+	/**
+	 * @brief The limits last applied to the SDK, so it is only told when they change.
+	 */
+	std::optional<BandwidthLimits> appliedLimits;
+
+	/**
+	 * @brief Re-applies the limits every second, so they change on their own when business hours start or end.
+	 */
+	std::thread limiterThread;
+	bool limiterStop = false;
+	std::condition_variable limiterCv;
+
+	/**
+	 * @brief Guards mapi against the limiter thread, along with the members above.
+	 */
+	std::mutex limiterMutex;
+
+	/**
+	 * @brief Applies the current limits of the limiter to the SDK, which throttles all of the session's transfers together.
+	 * limiterMutex must be held.
+	 */
+	void applyLimits();
+
+	/**
+	 * @brief Stops the limiter thread if it is running.
+	 */
+	void stopLimiter();
+
+	/**
+	 * @brief Maps cloud paths to the handles of the nodes they last resolved to.
+	 * getNodeByHandle() is a hash lookup inside the SDK, while getNodeByPath() searches the children of every folder on the path from the root.
+	 * Paths that do not exist are never cached, so creating nodes cannot leave a stale entry behind; moves and removals drop the affected subtree.
+	 * A cached node is only trusted if the path built from its parent chain is still the cached path.
+	 * That catches renames, moves and removals to the rubbish bin made by other sessions, at the cost of one parent lookup per path component.
+	 */
+	std::unordered_map<std::string, mega::MegaHandle> nodeCache;
+	std::mutex nodeCacheMutex;
+
+	/**
+	 * @brief Resolves a cloud path to a node, going through the node cache.
+	 *
+	 * @param path The path to resolve.
+	 *
+	 * @return The node, or nullptr if nothing exists at this path.
+	 */
+	std::unique_ptr<mega::MegaNode> getNode(std::string_view path);
+
+	/**
+	 * @brief Gets the children of a folder.
+	 *
+	 * @param dir The path of the folder.
+	 * @param order The order the SDK sorts the children in. mega::MegaApi::ORDER_NONE skips the sort.
+	 *
+	 * @return The children, or nullptr if the path does not point to a folder.
+	 */
+	std::unique_ptr<mega::MegaNodeList> getChildren(std::string_view dir, int order = mega::MegaApi::ORDER_DEFAULT_ASC){
+		std::unique_ptr<mega::MegaNode> node = getNode(dir);
+
+		if (!node){
+			lastError.setError(PATH_NOT_FOUND);
+			return nullptr;
+		}
+		if (node->isFile()){
+			lastError.setError(IS_FILE);
+			return nullptr;
+		}
+		return std::unique_ptr<mega::MegaNodeList>(mapi->getChildren(node.get(), order));
+	}
+
+	/**
+	 * @brief Adds a path to the node cache.
+	 */
+	void cacheNode(std::string_view path, mega::MegaHandle handle);
+
+	/**
+	 * @brief Drops a path from the node cache.
+	 *
+	 * @param path The path to drop.
+	 * @param recursive True if paths underneath this one should also be dropped.
+	 */
+	void invalidate(std::string_view path, bool recursive);
+
+	/**
+	 * @brief Finds the folder that a file should be uploaded into.
+	 *
+	 * @param disk_path The file to be uploaded.
+	 * @param cloud_path The location the file should be uploaded to.
+	 * @param newName Set to the name the file must be uploaded under, or std::nullopt if it keeps its disk filename.
+	 *
+	 * @return The destination folder, or nullptr on error.
+	 */
+	std::unique_ptr<mega::MegaNode> getUploadTarget(const char* disk_path, const char* cloud_path, std::optional<std::string>& newName);
+
+	/**
+	 * @brief Starts an upload that places the file under its final name in one request, so no rename is needed afterwards.
+	 *
+	 * @param name The name to upload the file under, or std::nullopt to keep its disk filename.
+	 */
+	void startUpload(const char* disk_path, mega::MegaNode* parent, const std::optional<std::string>& name, mega::MegaTransferListener* listener){
+		if (name){
+			mapi->startUpload(disk_path, parent, name.value().c_str(), listener);
+		}
+		else{
+			mapi->startUpload(disk_path, parent, listener);
+		}
+	}
 };
 
 class ProgressBarTransferListener : public mega::MegaTransferListener{
@@ -187,343 +557,1357 @@ private:
 	MegaClientError err;
 };
 
-static std::optional<std::string> CS_PURE string_parent_dir(const char* in){
-	std::string ret = in;
-	size_t index;
-	index = ret.find_last_of('/');
-	if (index == std::string::npos){
-		return {};
-	}
-	ret.resize(index + 1);
-	return ret;
-}
+/**
+ * @brief Reports the result of one asynchronous transfer through a promise and an optional callback.
+ * Instances are allocated with new and delete themselves once the transfer has finished.
+ */
+class AsyncTransferListener : public mega::MegaTransferListener{
+public:
+	AsyncTransferListener(MegaClientError& err, BaseClient::TransferCallback callback): err(err), callback(std::move(callback)){}
 
-static std::optional<std::string> CS_PURE string_filename(const char* in){
-	std::string ret = in;
-	size_t index;
-	index = ret.find_last_of('/');
-	if (index == std::string::npos){
-		return {};
+	std::future<bool> getFuture(){
+		return promise.get_future();
 	}
-	ret = in + index + 1;
-	return ret;
-}
 
-MegaClient::~MegaClient(){
-	if (impl->mapi){
-		logout();
+	void onTransferTemporaryError(mega::MegaApi* mega_api, mega::MegaTransfer* transfer, mega::MegaError* error){
+		(void)mega_api;
+		(void)transfer;
+		LOG(LEVEL_DEBUG) << "MEGA: Transfer Temporary Error: " << error->toString();
 	}
-}
 
-bool MegaClient::login(const char* username, const char* password){
-	mega::SynchronousRequestListener srl;
+	void onTransferFinish(mega::MegaApi* mega_api, mega::MegaTransfer* transfer, mega::MegaError* error){
+		bool res = error->getErrorCode() == mega::MegaError::API_OK;
 
-	if (impl->mapi != nullptr){
-		return false;
+		(void)mega_api;
+		(void)transfer;
+
+		if (!res){
+			err.setError(TRANSFER_ERROR, error->toString());
+		}
+		finish(res);
 	}
 
-	impl->mapi = std::make_unique<mega::MegaApi>(MEGA_API_KEY, (const char*)NULL, "cloudsync");
+	/**
+	 * @brief Reports the result of a transfer that finished without the SDK, and deletes this listener.
+	 */
+	void finish(bool res){
+		if (callback){
+			callback(res);
+		}
+		promise.set_value(res);
+		delete this;
+	}
 
-	impl->mapi->login(username, password, &srl);
-	if (srl.trywait(MEGA_WAIT_MS) != 0){
-		impl->lastError.setError(TIMED_OUT);
-		return false;
+private:
+	MegaClientError& err;
+	BaseClient::TransferCallback callback;
+	std::promise<bool> promise;
+};
+
+/**
+ * @brief Hands the data of a streaming transfer to a function as it arrives, and lets the caller wait for the transfer to finish.
+ */
+class StreamingTransferListener : public mega::MegaTransferListener{
+public:
+	using DataCallback = std::function<bool(const unsigned char*, size_t)>;
+
+	StreamingTransferListener(DataCallback onData): onData(std::move(onData)){}
+
+	bool onTransferData(mega::MegaApi* mega_api, mega::MegaTransfer* transfer, char* buffer, size_t size){
+		(void)mega_api;
+		(void)transfer;
+
+		// Returning false makes the SDK cancel the transfer.
+		try{
+			return onData(reinterpret_cast<const unsigned char*>(buffer), size);
+		}
+		catch (std::exception& e){
+			LOG(LEVEL_DEBUG) << "MEGA: Streaming transfer aborted: " << e.what();
+			return false;
+		}
 	}
-	if (srl.getError()->getErrorCode() != mega::MegaError::API_OK){
-		impl->lastError.setError(REQUEST_ERROR, srl.getError()->toString());
-		return false;
+
+	void onTransferTemporaryError(mega::MegaApi* mega_api, mega::MegaTransfer* transfer, mega::MegaError* error){
+		(void)mega_api;
+		(void)transfer;
+		LOG(LEVEL_DEBUG) << "MEGA: Transfer Temporary Error: " << error->toString();
 	}
 
-	impl->mapi->fetchNodes(&srl);
-	if (srl.trywait(MEGA_WAIT_MS) != 0){
-		impl->lastError.setError(TIMED_OUT);
-		return false;
+	void onTransferFinish(mega::MegaApi* mega_api, mega::MegaTransfer* transfer, mega::MegaError* error){
+		(void)mega_api;
+		(void)transfer;
+
+		{
+			std::unique_lock<std::mutex> lock(m);
+			this->error = std::unique_ptr<mega::MegaError>(error->copy());
+			notified = true;
+		}
+		cv.notify_all();
 	}
-	if (srl.getError()->getErrorCode() != mega::MegaError::API_OK){
-		LOG(LEVEL_ERROR) << "MEGA: Failed to fetch nodes (" << srl.getError()->toString() << ")";
-		impl->lastError.setError(REQUEST_ERROR, srl.getError()->toString());
-		return false;
+
+	void wait(){
+		std::unique_lock<std::mutex> lock(m);
+		cv.wait(lock, [this]{return notified;});
 	}
 
-	return true;
+	mega::MegaError* getError(){
+		return error.get();
+	}
+
+private:
+	DataCallback onData;
+	bool notified = false;
+	std::unique_ptr<mega::MegaError> error = nullptr;
+	std::condition_variable cv;
+	std::mutex m;
+};
+
+/**
+ * @brief Returns a future for a transfer that failed before it could be started.
+ */
+static std::future<bool> finished_transfer(bool res, const BaseClient::TransferCallback& callback){
+	std::promise<bool> promise;
+
+	if (callback){
+		callback(res);
+	}
+	promise.set_value(res);
+	return promise.get_future();
 }
 
-bool MegaClient::mkdir(const char* dir){
-	std::optional<std::string> parent_path;
-	std::optional<std::string> filename;
-	std::unique_ptr<mega::MegaNode> node;
-	mega::SynchronousRequestListener srl;
+static std::future<bool> failed_transfer(const BaseClient::TransferCallback& callback){
+	return finished_transfer(false, callback);
+}
 
-	node = std::unique_ptr<mega::MegaNode>(impl->mapi->getNodeByPath(dir));
-	if (node){
-		impl->lastError.setError(PATH_EXISTS);
-		return false;
+static std::optional<std::string_view> CS_PURE string_parent_dir(std::string_view in){
+	size_t index;
+	index = in.find_last_of('/');
+	if (index == std::string_view::npos){
+		return {};
 	}
+	return in.substr(0, index + 1);
+}
 
-	parent_path = string_parent_dir(dir);
-	if (!parent_path){
-		impl->lastError.setError(INVALID_PATH);
-		return false;
+static std::optional<std::string_view> CS_PURE string_filename(std::string_view in){
+	size_t index;
+	index = in.find_last_of('/');
+	if (index == std::string_view::npos){
+		return {};
 	}
+	return in.substr(index + 1);
+}
 
-	filename = string_filename(dir);
-	if (!filename){
-		impl->lastError.setError(INVALID_PATH);
-		return false;
+/**
+ * @brief Strips trailing slashes so "/a/b/" and "/a/b" share a cache entry.
+ */
+static std::string_view CS_PURE normalize_path(std::string_view in){
+	while (in.length() > 1 && in.back() == '/'){
+		in.remove_suffix(1);
 	}
+	return in;
+}
 
-	node = std::unique_ptr<mega::MegaNode>(impl->mapi->getNodeByPath(parent_path.value().c_str()));
-	if (!node){
-		impl->lastError.setError(PATH_NOT_FOUND);
-		return false;
+std::unique_ptr<mega::MegaNode> MegaClient::MegaClientImpl::getNode(std::string_view path){
+	std::string key(normalize_path(path));
+	std::unique_ptr<mega::MegaNode> node;
+	std::optional<mega::MegaHandle> handle;
+
+	{
+		std::lock_guard<std::mutex> lock(nodeCacheMutex);
+		auto it = nodeCache.find(key);
+		if (it != nodeCache.end()){
+			handle = it->second;
+		}
 	}
 
-	if (node->isFile()){
-		impl->lastError.setError(IS_FILE);
-		return false;
+	if (handle){
+		node = std::unique_ptr<mega::MegaNode>(mapi->getNodeByHandle(handle.value()));
+		// The node may have been renamed, moved or removed by another session since it was cached, all of which change its path.
+		std::unique_ptr<char[]> actual(node ? mapi->getNodePath(node.get()) : nullptr);
+		if (actual && key == actual.get()){
+			return node;
+		}
+		invalidate(key, node && node->isFolder());
 	}
 
-	impl->mapi->createFolder(filename.value().c_str(), node.get(), &srl);
-	if (srl.trywait(MEGA_WAIT_MS) != 0){
-		impl->lastError.setError(TIMED_OUT);
-		return false;
+	node = std::unique_ptr<mega::MegaNode>(mapi->getNodeByPath(key.c_str()));
+	if (node){
+		cacheNode(key, node->getHandle());
 	}
+	return node;
+}
 
-	if (srl.getError()->getErrorCode() != mega::MegaError::API_OK){
-		impl->lastError.setError(REQUEST_ERROR, srl.getError()->toString());
-		return false;
+void MegaClient::MegaClientImpl::cacheNode(std::string_view path, mega::MegaHandle handle){
+	std::lock_guard<std::mutex> lock(nodeCacheMutex);
+	nodeCache[std::string(normalize_path(path))] = handle;
+}
+
+void MegaClient::MegaClientImpl::invalidate(std::string_view path, bool recursive){
+	std::string_view key = normalize_path(path);
+	std::lock_guard<std::mutex> lock(nodeCacheMutex);
+
+	nodeCache.erase(std::string(key));
+	if (!recursive){
+		return;
+	}
+	for (auto it = nodeCache.begin(); it != nodeCache.end(); ){
+		const std::string& cached = it->first;
+		if (cached.length() > key.length() && cached.compare(0, key.length(), key) == 0 &&
+				(key.back() == '/' || cached[key.length()] == '/')){
+			it = nodeCache.erase(it);
+		}
+		else{
+			++it;
+		}
 	}
-	return true;
 }
 
-std::optional<std::vector<std::string>> MegaClient::readdir(const char* dir){
-	std::vector<std::string> ret;
+std::unique_ptr<mega::MegaNode> MegaClient::MegaClientImpl::getUploadTarget(const char* disk_path, const char* cloud_path, std::optional<std::string>& newName){
 	std::unique_ptr<mega::MegaNode> node;
-	std::unique_ptr<mega::MegaNodeList> children;
+	std::optional<std::string_view> parent_dir;
+	const char* disk_filename;
 
-	node = std::unique_ptr<mega::MegaNode>(impl->mapi->getNodeByPath(dir));
-	if (!node){
-		impl->lastError.setError(PATH_NOT_FOUND);
-		return std::nullopt;
+	newName = std::nullopt;
+
+	node = getNode(cloud_path);
+	if (node && node->isFile()){
+		lastError.setError(PATH_EXISTS);
+		return nullptr;
 	}
-	if (node->isFile()){
-		impl->lastError.setError(IS_FILE);
-		return std::nullopt;
+	// Uploading to an existing folder keeps the disk filename.
+	if (node){
+		return node;
 	}
 
-	children = std::unique_ptr<mega::MegaNodeList>(impl->mapi->getChildren(node.get()));
-	for (int i = 0; i < children->size(); ++i){
-		ret.push_back(children->get(i)->getName());
+	parent_dir = string_parent_dir(cloud_path);
+	if (!parent_dir ||
+			!(node = getNode(parent_dir.value()))){
+		lastError.setError(PATH_NOT_FOUND);
+		return nullptr;
 	}
-	return ret;
-}
-
-bool MegaClient::stat(const char* path, struct stat* st){
-	std::unique_ptr<mega::MegaNode> node(impl->mapi->getNodeByPath(path));
-
-	if (!node){
-		impl->lastError.setError(PATH_NOT_FOUND);
-		return false;
+	if (node->isFile()){
+		lastError.setError(IS_FILE);
+		return nullptr;
 	}
-	if (!st){
-		return true;
+
+	disk_filename = strrchr(disk_path, '/');
+	disk_filename = disk_filename ? disk_filename + 1 : disk_path;
+	newName = std::string(string_filename(cloud_path).value());
+	if (newName.value() == disk_filename){
+		newName = std::nullopt;
 	}
+	return node;
+}
 
+/**
+ * @brief Fills a stat structure with a node's attributes.
+ */
+static void node_stat(mega::MegaNode* node, struct stat* st){
 	st->st_uid = getuid();
 	st->st_gid = getgid();
 	st->st_mode = node->isFile() ? S_IFREG | 0444 : S_IFDIR | 0755;
 	st->st_nlink = 1;
+	st->st_size = node->isFile() ? node->getSize() : 0;
 	st->st_mtime = node->isFile() ? node->getModificationTime() : node->getCreationTime();
 	st->st_ctime = node->getCreationTime();
-
-	return true;
 }
 
-bool MegaClient::move(const char* old_path, const char* new_path){
-	std::unique_ptr<mega::MegaNode> nSrc;
-	std::unique_ptr<mega::MegaNode> nDst;
-	std::unique_ptr<mega::MegaNode> nTmp;
-	std::optional<std::string> parent_path;
-	std::optional<std::string> filename;
-	mega::SynchronousRequestListener srl;
-
-	if (strcmp(old_path, new_path) == 0){
-		return true;
+MegaClient::MegaClient(const char* cacheDir): impl(std::make_unique<MegaClientImpl>(*this)){
+	if (cacheDir){
+		impl->cacheDir = cacheDir;
 	}
+}
 
-	nSrc = std::unique_ptr<mega::MegaNode>(impl->mapi->getNodeByPath(old_path));
-	if (!nSrc){
-		impl->lastError.setError(PATH_NOT_FOUND);
-		return false;
+MegaClient::~MegaClient(){
+	impl->stopLimiter();
+	if (impl->mapi){
+		if (impl->sessionSaved){
+			suspend();
+		}
+		else{
+			logout();
+		}
 	}
+}
 
-	nDst = std::unique_ptr<mega::MegaNode>(impl->mapi->getNodeByPath(new_path));
-	if (!nDst){
-		parent_path = string_parent_dir(new_path);
-		filename = string_filename(new_path);
-		if (!parent_path || !filename){
-			impl->lastError.setError(INVALID_PATH);
-			return false;
+void MegaClient::MegaClientImpl::createApi(){
+	if (!cacheDir.empty()){
+		try{
+			fs::createDirectory(cacheDir.c_str());
+		}
+		catch (std::exception& e){
+			LOG(LEVEL_WARNING) << "MEGA: Could not create the cache directory, continuing without it (" << e.what() << ")";
+			cacheDir.clear();
 		}
+	}
 
-		nDst = std::unique_ptr<mega::MegaNode>(impl->mapi->getNodeByPath(parent_path.value().c_str()));
-		if (!nDst){
-			impl->lastError.setError(PATH_NOT_FOUND);
-			return false;
+	loadLatencies();
+	std::lock_guard<std::mutex> lock(limiterMutex);
+	mapi = std::make_unique<mega::MegaApi>(MEGA_API_KEY, cacheDir.empty() ? (const char*)NULL : cacheDir.c_str(), "cloudsync");
+	mapi->addTransferListener(&observerListener);
+	applyLimits();
+}
+
+void MegaClient::MegaClientImpl::loadLatencies(){
+	if (cacheDir.empty() || latenciesLoaded){
+		return;
+	}
+	latenciesLoaded = true;
+
+	// Each line is a request type followed by its latencies in milliseconds, oldest first.
+	std::ifstream ifs(cacheDir + "/latencies");
+	std::string line;
+	while (std::getline(ifs, line)){
+		std::istringstream iss(line);
+		size_t index;
+		long ms;
+
+		if (!(iss >> index) || index >= timeouts.size()){
+			continue;
 		}
-		if (nDst->isFile()){
-			impl->lastError.setError(IS_FILE);
-			return false;
+		while (iss >> ms){
+			timeouts[index].record(std::chrono::milliseconds(ms));
 		}
+	}
+}
 
-		nTmp = std::unique_ptr<mega::MegaNode>(impl->mapi->getChildNode(nDst.get(), filename.value().c_str()));
-		if (nTmp){
-			impl->lastError.setError(PATH_EXISTS);
-			return false;
+void MegaClient::MegaClientImpl::saveLatencies(){
+	if (cacheDir.empty()){
+		return;
+	}
+
+	std::ofstream ofs(cacheDir + "/latencies", std::ios_base::trunc);
+	for (size_t i = 0; i < timeouts.size(); ++i){
+		ofs << i;
+		for (auto latency : timeouts[i].getLatencies()){
+			ofs << ' ' << latency.count();
 		}
+		ofs << '\n';
 	}
-	if (nDst->isFile()){
-		impl->lastError.setError(PATH_EXISTS);
-		return false;
+	if (!ofs){
+		LOG(LEVEL_WARNING) << "MEGA: Could not save the request latencies to \"" << cacheDir << "\"";
 	}
+}
 
-	impl->mapi->moveNode(nSrc.get(), nDst.get(), &srl);
-	if (srl.trywait(MEGA_WAIT_MS) != 0){
-		impl->lastError.setError(TIMED_OUT);
-		return false;
+void MegaClient::MegaClientImpl::applyLimits(){
+	BandwidthLimits limits;
+
+	if (!mapi){
+		return;
 	}
-	if (srl.getError()->getErrorCode() != mega::MegaError::API_OK){
-		impl->lastError.setError(REQUEST_ERROR, srl.getError()->toString());
-		return false;
+	if (limiter){
+		limits = limiter->getCurrentLimits();
+	}
+	if (appliedLimits && appliedLimits.value() == limits){
+		return;
 	}
 
-	return true;
+	// The SDK takes 0 to mean unlimited, just like BandwidthLimits.
+	LOG(LEVEL_DEBUG) << "MEGA: Limiting uploads to " << limits.uploadBytesPerSecond << " B/s and downloads to " << limits.downloadBytesPerSecond << " B/s";
+	mapi->setMaxUploadSpeed(limits.uploadBytesPerSecond);
+	mapi->setMaxDownloadSpeed(limits.downloadBytesPerSecond);
+	appliedLimits = limits;
 }
 
-bool MegaClient::download(const char* cloud_path, const char* disk_path){
-	std::unique_ptr<mega::MegaNode> node;
-	ProgressBarTransferListener pbtl;
-
-	node = std::unique_ptr<mega::MegaNode>(impl->mapi->getNodeByPath(cloud_path));
-	if (!node){
-		impl->lastError.setError(PATH_NOT_FOUND);
-		return false;
+void MegaClient::MegaClientImpl::stopLimiter(){
+	if (!limiterThread.joinable()){
+		return;
 	}
-	if (!node->isFile()){
-		impl->lastError.setError(IS_DIRECTORY);
-		return false;
+	{
+		std::lock_guard<std::mutex> lock(limiterMutex);
+		limiterStop = true;
 	}
+	limiterCv.notify_all();
+	limiterThread.join();
+}
 
-	pbtl.setMsg(impl->uploadMsg);
-	impl->mapi->startDownload(node.get(), disk_path, &pbtl);
-	pbtl.wait();
-	if (pbtl.getError()->getErrorCode() != mega::MegaError::API_OK){
-		impl->lastError.setError(TRANSFER_ERROR, pbtl.getError()->toString());
+bool MegaClient::MegaClientImpl::runRequest(MegaRequestType type, const std::function<void(mega::MegaRequestListener*)>& send, mega::MegaHandle* handle){
+	std::vector<mega::MegaHandle> handles;
+
+	if (!runRequests(type, {send}, &handles)[0]){
 		return false;
 	}
+	if (handle){
+		*handle = handles[0];
+	}
 	return true;
 }
 
-bool MegaClient::upload(const char* disk_path, const char* cloud_path){
-	std::unique_ptr<mega::MegaNode> node;
-	ProgressBarTransferListener pbtl;
-	std::optional<std::string> parent_dir;
+std::vector<bool> MegaClient::MegaClientImpl::runRequests(MegaRequestType type, const std::vector<std::function<void(mega::MegaRequestListener*)>>& sends, std::vector<mega::MegaHandle>* handles){
+	const size_t index = static_cast<size_t>(type);
+	std::vector<bool> ret(sends.size(), false);
+	std::vector<size_t> todo(sends.size());
 
-	node = std::unique_ptr<mega::MegaNode>(impl->mapi->getNodeByPath(cloud_path));
-	if (node && node->isFile()){
-		impl->lastError.setError(PATH_EXISTS);
-		return false;
+	std::iota(todo.begin(), todo.end(), 0);
+	if (handles){
+		handles->assign(sends.size(), mega::INVALID_HANDLE);
 	}
 
-	if (!node){
-		parent_dir = string_parent_dir(cloud_path);
-		if (!parent_dir ||
-				!(node = std::unique_ptr<mega::MegaNode>(impl->mapi->getNodeByPath(parent_dir.value().c_str())))){
-			impl->lastError.setError(PATH_NOT_FOUND);
-			return false;
+	for (int attempt = 0; !todo.empty(); ++attempt){
+		const int timeoutMs = timeoutOverrides[index] > 0 ? timeoutOverrides[index] : timeouts[index].getTimeoutMs();
+		const bool canRetry = attempt < retryPolicy.maxRetries;
+		std::vector<size_t> retry;
+
+		for (size_t chunk = 0; chunk < todo.size(); chunk += MEGA_PIPELINE_DEPTH){
+			const size_t chunkEnd = std::min(todo.size(), chunk + MEGA_PIPELINE_DEPTH);
+			std::vector<std::unique_ptr<mega::SynchronousRequestListener>> listeners;
+			auto start = std::chrono::steady_clock::now();
+
+			for (size_t i = chunk; i < chunkEnd; ++i){
+				listeners.push_back(std::make_unique<mega::SynchronousRequestListener>());
+				sends[todo[i]](listeners.back().get());
+			}
+
+			// Each request gets the full timeout from when the one before it finished, as the server works through them in order.
+			for (size_t i = chunk; i < chunkEnd; ++i){
+				mega::SynchronousRequestListener& srl = *listeners[i - chunk];
+				const size_t job = todo[i];
+
+				// Sending a timed out request again would have the server do it twice if the first one is only slow.
+				int waits = 0;
+				bool timedOut;
+				while ((timedOut = srl.trywait(timeoutMs) != 0) && waits < retryPolicy.maxRetries){
+					LOG(LEVEL_DEBUG) << "MEGA: Request still pending after " << timeoutMs << "ms, retrying connections";
+					mapi->retryPendingConnections();
+					waits++;
+				}
+				if (timedOut){
+					// The request is still pending, so detach the listener before it goes out of scope.
+					mapi->removeRequestListener(&srl);
+					LOG(LEVEL_DEBUG) << "MEGA: Request timed out after " << timeoutMs << "ms";
+					lastError.setError(TIMED_OUT);
+					start = std::chrono::steady_clock::now();
+					continue;
+				}
+				// The server works through pipelined requests in order, so each one's latency runs from when the one before it finished.
+				const auto now = std::chrono::steady_clock::now();
+				timeouts[index].record(now - start);
+				start = now;
+
+				switch (srl.getError()->getErrorCode()){
+				case mega::MegaError::API_OK:
+					ret[job] = true;
+					if (handles){
+						(*handles)[job] = srl.getRequest()->getNodeHandle();
+					}
+					continue;
+				case mega::MegaError::API_EAGAIN:
+				case mega::MegaError::API_ERATELIMIT:
+				case mega::MegaError::API_ETEMPUNAVAIL:
+					congested();
+					if (canRetry){
+						LOG(LEVEL_DEBUG) << "MEGA: Retrying after temporary error (" << srl.getError()->toString() << ")";
+						retry.push_back(job);
+						continue;
+					}
+					break;
+				default:
+					break;
+				}
+				lastError.setError(REQUEST_ERROR, srl.getError()->toString());
+			}
 		}
+
+		if (!retry.empty()){
+			std::this_thread::sleep_for(retryPolicy.delay(attempt));
+		}
+		todo = std::move(retry);
+	}
+	return ret;
+}
+
+bool MegaClient::MegaClientImpl::finishLogin(const std::function<void(mega::MegaRequestListener*)>& send){
+	if (!runRequest(MegaRequestType::Login, send)){
+		reset();
+		return false;
+	}
+
+	if (!runRequest(MegaRequestType::FetchNodes, [this](mega::MegaRequestListener* listener){
+		mapi->fetchNodes(listener);
+	})){
+		LOG(LEVEL_ERROR) << "MEGA: Failed to fetch nodes (" << lastError.toString() << ")";
+		reset();
+		return false;
+	}
+
+	return true;
+}
+
+void MegaClient::MegaClientImpl::reset(){
+	saveLatencies();
+	{
+		std::lock_guard<std::mutex> lock(limiterMutex);
+		mapi = nullptr;
+		appliedLimits.reset();
+	}
+	sessionSaved = false;
+	std::lock_guard<std::mutex> lock(nodeCacheMutex);
+	nodeCache.clear();
+}
+
+bool MegaClient::login(const char* username, const char* password){
+	if (impl->mapi != nullptr){
+		return false;
+	}
+
+	impl->createApi();
+	return impl->finishLogin([this, username, password](mega::MegaRequestListener* listener){
+		impl->mapi->login(username, password, listener);
+	});
+}
+
+bool MegaClient::resumeSession(const ConfigFile& cf, const char* key){
+	if (impl->mapi != nullptr){
+		return false;
 	}
 
-	pbtl.setMsg(impl->downloadMsg);
-	impl->mapi->startUpload(disk_path, node.get(), &pbtl);
-	pbtl.wait();
-	if (pbtl.getError()->getErrorCode() != mega::MegaError::API_OK){
-		impl->lastError.setError(TRANSFER_ERROR, pbtl.getError()->toString());
+	auto entry = cf.readEntry(key);
+	if (!entry || entry->get().empty()){
+		impl->lastError.setError(SESSION_NOT_FOUND);
 		return false;
 	}
+	std::string session(entry->get().begin(), entry->get().end());
 
-	if (parent_dir){
-		std::unique_ptr<mega::MegaNode> nUploaded;
-		mega::SynchronousRequestListener srl;
+	impl->createApi();
+	if (!impl->finishLogin([this, &session](mega::MegaRequestListener* listener){
+		impl->mapi->fastLogin(session.c_str(), listener);
+	})){
+		return false;
+	}
+	// The session came from the ConfigFile, so it must outlive this client as well.
+	impl->sessionSaved = true;
+	return true;
+}
+
+bool MegaClient::saveSession(ConfigFile& cf, const char* key){
+	std::unique_ptr<char[]> session;
+
+	if (impl->mapi == nullptr){
+		impl->lastError.setError(SESSION_NOT_FOUND);
+		return false;
+	}
+
+	session = std::unique_ptr<char[]>(impl->mapi->dumpSession());
+	if (!session){
+		impl->lastError.setError(SESSION_NOT_FOUND);
+		return false;
+	}
+
+	cf.writeEntry(key, session.get(), strlen(session.get()));
+	impl->sessionSaved = true;
+	return true;
+}
+
+bool MegaClient::suspend(){
+	bool res;
+
+	if (impl->mapi == nullptr){
+		return true;
+	}
 
-		std::string f_old = parent_dir.value();
-		std::string f_new;
-		if (f_old[f_old.length() - 1] != '/'){
-			f_old += '/';
+	res = impl->runRequest(MegaRequestType::Logout, [this](mega::MegaRequestListener* listener){
+		impl->mapi->localLogout(listener);
+	});
+	impl->reset();
+	return res;
+}
+
+std::optional<MegaClient::MegaClientImpl::PreparedRequest> MegaClient::MegaClientImpl::prepareMkdir(const char* dir){
+	std::optional<std::string_view> parent_path;
+	std::optional<std::string_view> filename;
+	std::shared_ptr<mega::MegaNode> node;
+
+	node = getNode(dir);
+	if (node){
+		lastError.setError(PATH_EXISTS);
+		return std::nullopt;
+	}
+
+	parent_path = string_parent_dir(dir);
+	if (!parent_path){
+		lastError.setError(INVALID_PATH);
+		return std::nullopt;
+	}
+
+	filename = string_filename(dir);
+	if (!filename){
+		lastError.setError(INVALID_PATH);
+		return std::nullopt;
+	}
+
+	node = getNode(parent_path.value());
+	if (!node){
+		lastError.setError(PATH_NOT_FOUND);
+		return std::nullopt;
+	}
+
+	if (node->isFile()){
+		lastError.setError(IS_FILE);
+		return std::nullopt;
+	}
+
+	return PreparedRequest{
+		[this, name = std::string(filename.value()), node](mega::MegaRequestListener* listener){
+			mapi->createFolder(name.c_str(), node.get(), listener);
+		},
+		// Children of a new directory are usually created right after it.
+		[this, path = std::string(dir)](mega::MegaHandle handle){
+			cacheNode(path, handle);
 		}
-		f_new = f_old;
-		f_old += string_filename(disk_path).value();
-		f_new += string_filename(cloud_path).value();
+	};
+}
 
-		nUploaded = std::unique_ptr<mega::MegaNode>(impl->mapi->getNodeByPath(f_old.c_str()));
-		if (!nUploaded){
-			impl->lastError.setError(SHOULDNEVERHAPPEN_ERROR);
-			return false;
+bool MegaClient::mkdir(const char* dir){
+	std::optional<MegaClientImpl::PreparedRequest> req;
+	mega::MegaHandle handle;
+
+	req = impl->prepareMkdir(dir);
+	if (!req || !impl->runRequest(MegaRequestType::Mkdir, req->send, &handle)){
+		return false;
+	}
+	req->onSuccess(handle);
+	return true;
+}
+
+std::optional<std::vector<std::string>> MegaClient::readdir(const char* dir){
+	std::vector<std::string> ret;
+	std::unique_ptr<mega::MegaNodeList> children;
+
+	children = impl->getChildren(dir);
+	if (!children){
+		return std::nullopt;
+	}
+
+	ret.reserve(children->size());
+	for (int i = 0; i < children->size(); ++i){
+		ret.push_back(children->get(i)->getName());
+	}
+	return ret;
+}
+
+bool MegaClient::readdirVisit(const char* dir, const ReaddirVisitor& visitor){
+	std::unique_ptr<mega::MegaNodeList> children;
+
+	// The SDK can only hand out a copy of every child, so this saves the vector of names that readdir() builds on top of it, and the sort.
+	children = impl->getChildren(dir, mega::MegaApi::ORDER_NONE);
+	if (!children){
+		return false;
+	}
+
+	for (int i = 0; i < children->size(); ++i){
+		if (!visitor(children->get(i)->getName())){
+			break;
 		}
+	}
+	return true;
+}
+
+std::optional<std::vector<DirEntry>> MegaClient::readdirPlus(const char* dir){
+	std::vector<DirEntry> ret;
+	std::unique_ptr<mega::MegaNodeList> children;
+
+	// The child list already holds every attribute, so no further lookups are needed.
+	children = impl->getChildren(dir);
+	if (!children){
+		return std::nullopt;
+	}
+	ret.resize(children->size());
+	for (int i = 0; i < children->size(); ++i){
+		mega::MegaNode* child = children->get(i);
+		const char* fingerprint = child->getFingerprint();
 
-		impl->mapi->renameNode(nUploaded.get(), f_new.c_str(), &srl);
-		if (srl.trywait(MEGA_WAIT_MS) != 0){
-			impl->lastError.setError(TIMED_OUT);
+		ret[i].name = child->getName();
+		node_stat(child, &ret[i].st);
+		if (fingerprint){
+			ret[i].fingerprint = fingerprint;
 		}
-		if (srl.getError()->getErrorCode() != mega::MegaError::API_OK){
-			impl->lastError.setError(REQUEST_ERROR, srl.getError()->toString());
+	}
+	return ret;
+}
+
+bool MegaClient::stat(const char* path, struct stat* st){
+	std::unique_ptr<mega::MegaNode> node(impl->getNode(path));
+
+	if (!node){
+		impl->lastError.setError(PATH_NOT_FOUND);
+		return false;
+	}
+	if (!st){
+		return true;
+	}
+
+	node_stat(node.get(), st);
+	return true;
+}
+
+std::optional<MegaClient::MegaClientImpl::PreparedRequest> MegaClient::MegaClientImpl::prepareMove(const char* old_path, const char* new_path){
+	std::shared_ptr<mega::MegaNode> nSrc;
+	std::shared_ptr<mega::MegaNode> nDst;
+	std::unique_ptr<mega::MegaNode> nTmp;
+	std::optional<std::string_view> parent_path;
+	std::optional<std::string_view> filename;
+
+	nSrc = getNode(old_path);
+	if (!nSrc){
+		lastError.setError(PATH_NOT_FOUND);
+		return std::nullopt;
+	}
+
+	nDst = getNode(new_path);
+	if (!nDst){
+		parent_path = string_parent_dir(new_path);
+		filename = string_filename(new_path);
+		if (!parent_path || !filename){
+			lastError.setError(INVALID_PATH);
+			return std::nullopt;
+		}
+
+		nDst = getNode(parent_path.value());
+		if (!nDst){
+			lastError.setError(PATH_NOT_FOUND);
+			return std::nullopt;
 		}
+		if (nDst->isFile()){
+			lastError.setError(IS_FILE);
+			return std::nullopt;
+		}
+
+		nTmp = std::unique_ptr<mega::MegaNode>(mapi->getChildNode(nDst.get(), std::string(filename.value()).c_str()));
+		if (nTmp){
+			lastError.setError(PATH_EXISTS);
+			return std::nullopt;
+		}
+	}
+	if (nDst->isFile()){
+		lastError.setError(PATH_EXISTS);
+		return std::nullopt;
+	}
+
+	return PreparedRequest{
+		[this, nSrc, nDst](mega::MegaRequestListener* listener){
+			mapi->moveNode(nSrc.get(), nDst.get(), listener);
+		},
+		[this, path = std::string(old_path), recursive = nSrc->isFolder()](mega::MegaHandle){
+			invalidate(path, recursive);
+		}
+	};
+}
+
+bool MegaClient::move(const char* old_path, const char* new_path){
+	std::optional<MegaClientImpl::PreparedRequest> req;
+
+	if (strcmp(old_path, new_path) == 0){
+		return true;
+	}
+
+	req = impl->prepareMove(old_path, new_path);
+	if (!req || !impl->runRequest(MegaRequestType::Move, req->send)){
+		return false;
 	}
+	req->onSuccess(mega::INVALID_HANDLE);
 	return true;
 }
 
-bool MegaClient::remove(const char* path){
+bool MegaClient::copy(const char* src_path, const char* dst_path){
+	std::unique_ptr<mega::MegaNode> nSrc;
+	std::unique_ptr<mega::MegaNode> nDst;
+	std::unique_ptr<mega::MegaNode> nTmp;
+	std::optional<std::string_view> parent_path;
+	std::optional<std::string> filename;
+
+	nSrc = impl->getNode(src_path);
+	if (!nSrc){
+		impl->lastError.setError(PATH_NOT_FOUND);
+		return false;
+	}
+
+	nDst = impl->getNode(dst_path);
+	if (nDst && nDst->isFile()){
+		impl->lastError.setError(PATH_EXISTS);
+		return false;
+	}
+	// Copying onto a folder places the copy inside of it under the same name.
+	if (nDst){
+		nTmp = std::unique_ptr<mega::MegaNode>(impl->mapi->getChildNode(nDst.get(), nSrc->getName()));
+	}
+	else{
+		parent_path = string_parent_dir(dst_path);
+		if (!parent_path || !string_filename(dst_path)){
+			impl->lastError.setError(INVALID_PATH);
+			return false;
+		}
+		filename = std::string(string_filename(dst_path).value());
+
+		nDst = impl->getNode(parent_path.value());
+		if (!nDst){
+			impl->lastError.setError(PATH_NOT_FOUND);
+			return false;
+		}
+		if (nDst->isFile()){
+			impl->lastError.setError(IS_FILE);
+			return false;
+		}
+		nTmp = std::unique_ptr<mega::MegaNode>(impl->mapi->getChildNode(nDst.get(), filename.value().c_str()));
+	}
+	if (nTmp){
+		impl->lastError.setError(PATH_EXISTS);
+		return false;
+	}
+
+	// The whole tree is copied on the server, so no file contents go through this machine.
+	return impl->runRequest(MegaRequestType::Copy, [this, &nSrc, &nDst, &filename](mega::MegaRequestListener* listener){
+		if (filename){
+			impl->mapi->copyNode(nSrc.get(), nDst.get(), filename.value().c_str(), listener);
+		}
+		else{
+			impl->mapi->copyNode(nSrc.get(), nDst.get(), listener);
+		}
+	});
+}
+
+bool MegaClient::download(const char* cloud_path, const char* disk_path){
 	std::unique_ptr<mega::MegaNode> node;
-	mega::SynchronousRequestListener srl;
+	bool ranged;
 
-	node = std::unique_ptr<mega::MegaNode>(impl->mapi->getNodeByPath(path));
+	node = impl->getNode(cloud_path);
 	if (!node){
 		impl->lastError.setError(PATH_NOT_FOUND);
+		return false;
 	}
+	if (!node->isFile()){
+		impl->lastError.setError(IS_DIRECTORY);
+		return false;
+	}
+	ranged = impl->rangedDownloadCount > 1 && static_cast<uint64_t>(node->getSize()) >= impl->rangedDownloadMin && node->getSize() > 0;
+	// A regular download cannot start partway through a file, so journaled downloads always go through the ranged path.
+	if (ranged || impl->journal){
+		return impl->downloadRanges(node.get(), cloud_path, disk_path, ranged ? impl->rangedDownloadCount : 1);
+	}
+
+	for (int attempt = 0; ; ++attempt){
+		ProgressBarTransferListener pbtl;
 
-	impl->mapi->remove(node.get(), &srl);
-	if (srl.trywait(MEGA_WAIT_MS) != 0){
-		impl->lastError.setError(TIMED_OUT);
+		pbtl.setMsg(impl->downloadMsg);
+		impl->mapi->startDownload(node.get(), disk_path, &pbtl);
+		pbtl.wait();
+		if (pbtl.getError()->getErrorCode() == mega::MegaError::API_OK){
+			return true;
+		}
+		if (attempt >= impl->retryPolicy.maxRetries){
+			impl->lastError.setError(TRANSFER_ERROR, pbtl.getError()->toString());
+			return false;
+		}
+		LOG(LEVEL_DEBUG) << "MEGA: Retrying download of \"" << cloud_path << "\" (" << pbtl.getError()->toString() << ")";
+		std::this_thread::sleep_for(impl->retryPolicy.delay(attempt));
+	}
+}
+
+bool MegaClient::MegaClientImpl::downloadRanges(mega::MegaNode* node, const char* cloud_path, const char* disk_path, int nRanges){
+	const uint64_t size = node->getSize();
+	std::optional<TransferRecord> record;
+	std::mutex recordMutex;
+	auto lastCheckpoint = std::chrono::steady_clock::now();
+	ProgressBar p;
+	struct stat st;
+	bool res = false;
+	int fd;
+
+	if (journal){
+		record = journal->get(TransferType::Download, disk_path, cloud_path);
+	}
+	// The partial file is only worth keeping if it holds the same version of the same file.
+	if (record && (record->sourceId != node->getHandle() || record->size != size || record->mtime != node->getModificationTime() ||
+		::stat(disk_path, &st) != 0 || static_cast<uint64_t>(st.st_size) != size)){
+		LOG(LEVEL_DEBUG) << "MEGA: \"" << cloud_path << "\" changed since its download was interrupted, starting over";
+		record.reset();
+	}
+
+	if (record){
+		LOG(LEVEL_DEBUG) << "MEGA: Resuming download of \"" << cloud_path << "\" with " << record->remaining() << " of " << size << " bytes left";
+		fd = open(disk_path, O_WRONLY);
+	}
+	else{
+		const uint64_t rangeLen = (size + nRanges - 1) / nRanges;
+
+		record = TransferRecord();
+		record->type = TransferType::Download;
+		record->diskPath = disk_path;
+		record->cloudPath = cloud_path;
+		record->size = size;
+		record->mtime = node->getModificationTime();
+		record->sourceId = node->getHandle();
+		for (uint64_t start = 0; start < size; start += rangeLen){
+			record->pending.emplace_back(start, std::min(start + rangeLen, size));
+		}
+		fd = open(disk_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if (fd < 0){
+		LOG(LEVEL_DEBUG) << "MEGA: Could not open \"" << disk_path << "\" (" << std::strerror(errno) << ")";
+		lastError.setError(TRANSFER_ERROR, std::strerror(errno));
 		return false;
 	}
-	if (srl.getError()->getErrorCode() != mega::MegaError::API_OK){
-		impl->lastError.setError(REQUEST_ERROR, srl.getError()->toString());
+	// Reserving the space up front keeps the ranges from fragmenting the file. Not every filesystem supports this.
+	if (size > 0 && posix_fallocate(fd, 0, size) != 0 && ftruncate(fd, size) != 0){
+		LOG(LEVEL_DEBUG) << "MEGA: Could not preallocate \"" << disk_path << "\" (" << std::strerror(errno) << ")";
+		lastError.setError(TRANSFER_ERROR, std::strerror(errno));
+		close(fd);
+		unlink(disk_path);
 		return false;
 	}
+	if (journal){
+		checkpoint(*record);
+	}
+
+	p.setMsg(downloadMsg);
+	p.setMax(size);
+	p.setProgress(size - record->remaining());
+	p.display();
+
+	for (int attempt = 0; ; ++attempt){
+		std::vector<std::unique_ptr<StreamingTransferListener>> listeners;
+		std::string error;
+
+		for (auto& range : record->pending){
+			// Each range advances its own write position, as they arrive independently of each other.
+			auto onData = [this, fd, &range, &record, &recordMutex, &lastCheckpoint, &p](const unsigned char* buf, size_t bufLen){
+				while (bufLen > 0){
+					ssize_t written = pwrite(fd, buf, bufLen, range.first);
+					if (written < 0){
+						if (errno == EINTR){
+							continue;
+						}
+						LOG(LEVEL_DEBUG) << "MEGA: Write failed during ranged download (" << std::strerror(errno) << ")";
+						return false;
+					}
+					buf += written;
+					bufLen -= written;
+					p.incProgress(written);
+
+					std::optional<TransferRecord> snapshot;
+					{
+						std::lock_guard<std::mutex> lock(recordMutex);
+						range.first += written;
+						if (journal && std::chrono::steady_clock::now() - lastCheckpoint >= std::chrono::seconds(1)){
+							lastCheckpoint = std::chrono::steady_clock::now();
+							snapshot = *record;
+						}
+					}
+					// Every byte the snapshot counts was written before the sync, so syncing outside the lock is safe and does not stall the other ranges.
+					if (snapshot){
+						checkpoint(*snapshot, fd);
+					}
+				}
+				return true;
+			};
+
+			listeners.push_back(std::make_unique<StreamingTransferListener>(onData));
+			mapi->startStreaming(node, range.first, range.second - range.first, listeners.back().get());
+		}
+
+		for (auto& listener : listeners){
+			listener->wait();
+			if (error.empty() && listener->getError()->getErrorCode() != mega::MegaError::API_OK){
+				error = listener->getError()->toString();
+			}
+		}
+
+		record->pending.erase(std::remove_if(record->pending.begin(), record->pending.end(), [](const auto& range){
+			return range.first >= range.second;
+		}), record->pending.end());
+		if (record->pending.empty()){
+			res = true;
+			break;
+		}
+		if (journal){
+			checkpoint(*record, fd);
+		}
+		if (attempt >= retryPolicy.maxRetries){
+			lastError.setError(TRANSFER_ERROR, error.c_str());
+			break;
+		}
+		LOG(LEVEL_DEBUG) << "MEGA: Retrying download of \"" << cloud_path << "\" with " << record->remaining() << " bytes left (" << error << ")";
+		std::this_thread::sleep_for(retryPolicy.delay(attempt));
+	}
 
+	if (res){
+		// Match the modification time a regular download would have set.
+		struct timespec times[2];
+		times[0].tv_sec = times[1].tv_sec = node->getModificationTime();
+		times[0].tv_nsec = times[1].tv_nsec = 0;
+		futimens(fd, times);
+		p.finish();
+		forget(TransferType::Download, disk_path, cloud_path);
+	}
+	else{
+		p.fail();
+	}
+
+	close(fd);
+	// Without a journal the partial file could never be resumed.
+	if (!res && !journal){
+		unlink(disk_path);
+	}
+	return res;
+}
+
+bool MegaClient::MegaClientImpl::placeByFingerprint(const char* disk_path, mega::MegaNode* parent, const std::optional<std::string>& name){
+	std::unique_ptr<char[]> fingerprint;
+	std::unique_ptr<mega::MegaNode> existing;
+	const char* target;
+
+	if (!fingerprintSkip){
+		return false;
+	}
+
+	fingerprint = std::unique_ptr<char[]>(mapi->getFingerprint(disk_path));
+	if (!fingerprint){
+		LOG(LEVEL_DEBUG) << "MEGA: Could not fingerprint \"" << disk_path << "\"";
+		return false;
+	}
+	// Matches in the target folder are preferred, as they may already be the file being uploaded.
+	existing = std::unique_ptr<mega::MegaNode>(mapi->getNodeByFingerprint(fingerprint.get(), parent));
+	if (!existing){
+		return false;
+	}
+
+	if (name){
+		target = name.value().c_str();
+	}
+	else{
+		target = strrchr(disk_path, '/');
+		target = target ? target + 1 : disk_path;
+	}
+
+	if (existing->getParentHandle() == parent->getHandle() && strcmp(existing->getName(), target) == 0){
+		LOG(LEVEL_DEBUG) << "MEGA: \"" << disk_path << "\" is already uploaded, skipping it";
+		return true;
+	}
+
+	LOG(LEVEL_DEBUG) << "MEGA: \"" << disk_path << "\" matches \"" << existing->getName() << "\", copying it instead of uploading";
+	if (!runRequest(MegaRequestType::Copy, [this, &existing, parent, target](mega::MegaRequestListener* listener){
+		mapi->copyNode(existing.get(), parent, target, listener);
+	})){
+		LOG(LEVEL_DEBUG) << "MEGA: Copy failed, uploading instead (" << lastError.toString() << ")";
+		return false;
+	}
 	return true;
 }
 
-bool MegaClient::logout(){
-	mega::SynchronousRequestListener srl;
-	int res;
+void MegaClient::MegaClientImpl::checkpoint(const TransferRecord& record, int fd){
+	if (fd >= 0 && fdatasync(fd) != 0){
+		LOG(LEVEL_WARNING) << "MEGA: Could not sync the download, so its progress is not recorded (" << std::strerror(errno) << ")";
+		return;
+	}
+	try{
+		journal->put(record);
+		journal->flush();
+	}
+	catch (std::exception& e){
+		LOG(LEVEL_WARNING) << "MEGA: Could not write the transfer journal (" << e.what() << ")";
+	}
+}
 
-	if (impl->mapi == nullptr){
+void MegaClient::MegaClientImpl::forget(TransferType type, const char* disk_path, const char* cloud_path){
+	if (!journal){
+		return;
+	}
+	try{
+		journal->remove(type, disk_path, cloud_path);
+		journal->flush();
+	}
+	catch (std::exception& e){
+		LOG(LEVEL_WARNING) << "MEGA: Could not write the transfer journal (" << e.what() << ")";
+	}
+}
+
+bool MegaClient::downloadStream(const char* cloud_path, const DownloadSink& sink){
+	std::unique_ptr<mega::MegaNode> node;
+
+	node = impl->getNode(cloud_path);
+	if (!node){
+		impl->lastError.setError(PATH_NOT_FOUND);
+		return false;
+	}
+	if (!node->isFile()){
+		impl->lastError.setError(IS_DIRECTORY);
+		return false;
+	}
+	if (node->getSize() == 0){
 		return true;
 	}
 
-	impl->mapi->logout(&srl);
-	res = srl.trywait(MEGA_WAIT_MS);
-	impl->mapi = nullptr;
+	StreamingTransferListener stl(sink);
+	impl->mapi->startStreaming(node.get(), 0, node->getSize(), &stl);
+	stl.wait();
+	if (stl.getError()->getErrorCode() != mega::MegaError::API_OK){
+		impl->lastError.setError(TRANSFER_ERROR, stl.getError()->toString());
+		return false;
+	}
+	return true;
+}
+
+bool MegaClient::upload(const char* disk_path, const char* cloud_path){
+	std::unique_ptr<mega::MegaNode> node;
+	std::optional<std::string> newName;
+	struct stat st;
+
+	node = impl->getUploadTarget(disk_path, cloud_path, newName);
+	if (!node){
+		return false;
+	}
+	if (impl->placeByFingerprint(disk_path, node.get(), newName)){
+		return true;
+	}
+
+	// The SDK keeps track of how much of an upload was sent, so the journal only needs to remember that it was started.
+	if (impl->journal && ::stat(disk_path, &st) == 0){
+		TransferRecord record;
+		record.type = TransferType::Upload;
+		record.diskPath = disk_path;
+		record.cloudPath = cloud_path;
+		record.size = st.st_size;
+		record.mtime = st.st_mtime;
+		record.pending.emplace_back(0, st.st_size);
+		impl->checkpoint(record);
+	}
+
+	for (int attempt = 0; ; ++attempt){
+		ProgressBarTransferListener pbtl;
+
+		pbtl.setMsg(impl->uploadMsg);
+		impl->startUpload(disk_path, node.get(), newName, &pbtl);
+		pbtl.wait();
+		if (pbtl.getError()->getErrorCode() == mega::MegaError::API_OK){
+			impl->forget(TransferType::Upload, disk_path, cloud_path);
+			return true;
+		}
+		if (attempt >= impl->retryPolicy.maxRetries){
+			impl->lastError.setError(TRANSFER_ERROR, pbtl.getError()->toString());
+			return false;
+		}
+		LOG(LEVEL_DEBUG) << "MEGA: Retrying upload of \"" << disk_path << "\" (" << pbtl.getError()->toString() << ")";
+		std::this_thread::sleep_for(impl->retryPolicy.delay(attempt));
+	}
+}
+
+std::future<bool> MegaClient::downloadAsync(const char* cloud_path, const char* disk_path, TransferCallback callback){
+	std::unique_ptr<mega::MegaNode> node;
+	AsyncTransferListener* atl;
+
+	// Journaled transfers need the bookkeeping of the synchronous path.
+	if (impl->journal){
+		return BaseClient::downloadAsync(cloud_path, disk_path, std::move(callback));
+	}
+
+	node = impl->getNode(cloud_path);
+	if (!node){
+		impl->lastError.setError(PATH_NOT_FOUND);
+		return failed_transfer(callback);
+	}
+	if (!node->isFile()){
+		impl->lastError.setError(IS_DIRECTORY);
+		return failed_transfer(callback);
+	}
+
+	// The listener deletes itself when the transfer finishes.
+	atl = new AsyncTransferListener(impl->lastError, std::move(callback));
+	std::future<bool> ret = atl->getFuture();
+	impl->mapi->startDownload(node.get(), disk_path, atl);
+	return ret;
+}
+
+std::future<bool> MegaClient::uploadAsync(const char* disk_path, const char* cloud_path, TransferCallback callback){
+	std::unique_ptr<mega::MegaNode> node;
+	std::optional<std::string> newName;
+	AsyncTransferListener* atl;
+
+	if (impl->journal){
+		return BaseClient::uploadAsync(disk_path, cloud_path, std::move(callback));
+	}
+
+	node = impl->getUploadTarget(disk_path, cloud_path, newName);
+	if (!node){
+		return failed_transfer(callback);
+	}
+
+	// The listener deletes itself when the transfer finishes.
+	atl = new AsyncTransferListener(impl->lastError, std::move(callback));
+	std::future<bool> ret = atl->getFuture();
+	if (!impl->fingerprintSkip){
+		impl->startUpload(disk_path, node.get(), newName, atl);
+		return ret;
+	}
+
+	// Fingerprinting reads the whole file and a match may cost a copy request, so neither is done on the caller's thread.
+	std::thread([this, disk = std::string(disk_path), parent = std::shared_ptr<mega::MegaNode>(std::move(node)), newName, atl]{
+		if (impl->placeByFingerprint(disk.c_str(), parent.get(), newName)){
+			atl->finish(true);
+			return;
+		}
+		impl->startUpload(disk.c_str(), parent.get(), newName, atl);
+	}).detach();
+	return ret;
+}
 
-	if (res != 0){
-		impl->lastError.setError(TIMED_OUT);
-		impl->mapi = nullptr;
+std::optional<MegaClient::MegaClientImpl::PreparedRequest> MegaClient::MegaClientImpl::prepareRemove(const char* path){
+	std::shared_ptr<mega::MegaNode> node;
+
+	node = getNode(path);
+	if (!node){
+		lastError.setError(PATH_NOT_FOUND);
+		return std::nullopt;
+	}
+
+	return PreparedRequest{
+		[this, node](mega::MegaRequestListener* listener){
+			mapi->remove(node.get(), listener);
+		},
+		[this, p = std::string(path), recursive = node->isFolder()](mega::MegaHandle){
+			invalidate(p, recursive);
+		}
+	};
+}
+
+bool MegaClient::remove(const char* path){
+	std::optional<MegaClientImpl::PreparedRequest> req;
+
+	req = impl->prepareRemove(path);
+	if (!req || !impl->runRequest(MegaRequestType::Remove, req->send)){
 		return false;
 	}
+	req->onSuccess(mega::INVALID_HANDLE);
 	return true;
 }
 
+bool MegaClient::removeRecursive(const char* path, const RemoveProgress& progress){
+	// The server removes a folder along with everything under it.
+	if (!remove(path)){
+		return false;
+	}
+	if (progress){
+		progress(1, 1);
+	}
+	return true;
+}
+
+void MegaClient::MegaClientImpl::runPrepared(MegaRequestType type, std::vector<PreparedRequest>& requests, const std::vector<size_t>& indices, std::vector<bool>& ret){
+	std::vector<std::function<void(mega::MegaRequestListener*)>> sends;
+	std::vector<mega::MegaHandle> handles;
+	std::vector<bool> res;
+
+	if (requests.empty()){
+		return;
+	}
+	for (PreparedRequest& req : requests){
+		sends.push_back(req.send);
+	}
+
+	res = runRequests(type, sends, &handles);
+	for (size_t i = 0; i < requests.size(); ++i){
+		if (res[i]){
+			requests[i].onSuccess(handles[i]);
+			ret[indices[i]] = true;
+		}
+	}
+}
+
+std::vector<bool> MegaClient::mkdirAll(const std::vector<std::string>& dirs){
+	std::vector<bool> ret(dirs.size(), false);
+	std::unordered_map<std::string_view, size_t> first;
+
+	for (const auto& wave : depthWaves(std::vector<std::string_view>(dirs.begin(), dirs.end()), false)){
+		std::vector<MegaClientImpl::PreparedRequest> requests;
+		std::vector<size_t> indices;
+
+		for (size_t i : wave){
+			std::unique_ptr<mega::MegaNode> node;
+
+			// Sending the same mkdir twice would create two folders with the same name.
+			if (!first.emplace(normalize_path(dirs[i]), i).second){
+				continue;
+			}
+			node = impl->getNode(dirs[i]);
+			if (node && node->isFolder()){
+				ret[i] = true;
+				continue;
+			}
+
+			auto req = impl->prepareMkdir(dirs[i].c_str());
+			if (req){
+				requests.push_back(std::move(req.value()));
+				indices.push_back(i);
+			}
+		}
+		// The next wave finds its parents in the node cache.
+		impl->runPrepared(MegaRequestType::Mkdir, requests, indices, ret);
+	}
+
+	for (size_t i = 0; i < dirs.size(); ++i){
+		ret[i] = ret[first[normalize_path(dirs[i])]];
+	}
+	return ret;
+}
+
+std::vector<bool> MegaClient::moveMany(const std::vector<std::pair<std::string, std::string>>& moves){
+	std::vector<bool> ret(moves.size(), false);
+	std::vector<std::string_view> sources;
+
+	for (const auto& m : moves){
+		sources.push_back(m.first);
+	}
+	for (const auto& wave : depthWaves(sources, true)){
+		std::vector<MegaClientImpl::PreparedRequest> requests;
+		std::vector<size_t> indices;
+
+		for (size_t i : wave){
+			if (moves[i].first == moves[i].second){
+				ret[i] = true;
+				continue;
+			}
+			auto req = impl->prepareMove(moves[i].first.c_str(), moves[i].second.c_str());
+			if (req){
+				requests.push_back(std::move(req.value()));
+				indices.push_back(i);
+			}
+		}
+		impl->runPrepared(MegaRequestType::Move, requests, indices, ret);
+	}
+	return ret;
+}
+
+std::vector<bool> MegaClient::removeMany(const std::vector<std::string>& paths){
+	std::vector<bool> ret(paths.size(), false);
+
+	for (const auto& wave : depthWaves(std::vector<std::string_view>(paths.begin(), paths.end()), true)){
+		std::vector<MegaClientImpl::PreparedRequest> requests;
+		std::vector<size_t> indices;
+
+		for (size_t i : wave){
+			auto req = impl->prepareRemove(paths[i].c_str());
+			if (req){
+				requests.push_back(std::move(req.value()));
+				indices.push_back(i);
+			}
+		}
+		impl->runPrepared(MegaRequestType::Remove, requests, indices, ret);
+	}
+	return ret;
+}
+
+bool MegaClient::logout(){
+	bool res;
+
+	if (impl->mapi == nullptr){
+		return true;
+	}
+
+	res = impl->runRequest(MegaRequestType::Logout, [this](mega::MegaRequestListener* listener){
+		impl->mapi->logout(listener);
+	});
+	impl->reset();
+	return res;
+}
+
 const char* MegaClient::getLastError(){
 	return impl->lastError.toString();
 }
@@ -544,4 +1928,82 @@ void MegaClient::setDownloadMsg(const char* msg){
 	this->impl->downloadMsg = msg;
 }
 
+void MegaClient::setRangedDownload(uint64_t minSize, int nRanges){
+	this->impl->rangedDownloadMin = minSize;
+	this->impl->rangedDownloadCount = nRanges;
+}
+
+void MegaClient::setRequestTimeout(MegaRequestType type, int millis){
+	this->impl->timeoutOverrides[static_cast<size_t>(type)] = millis;
+}
+
+void MegaClient::setRetryPolicy(const RetryPolicy& policy){
+	this->impl->retryPolicy = policy;
+}
+
+void MegaClient::setBandwidthLimiter(BandwidthLimiter* limiter){
+	MegaClientImpl* i = this->impl.get();
+
+	i->stopLimiter();
+	{
+		std::lock_guard<std::mutex> lock(i->limiterMutex);
+		i->limiter = limiter;
+		i->limiterStop = false;
+		i->applyLimits();
+	}
+	if (!limiter){
+		return;
+	}
+
+	i->limiterThread = std::thread([i]{
+		std::unique_lock<std::mutex> lock(i->limiterMutex);
+		while (!i->limiterCv.wait_for(lock, std::chrono::seconds(1), [i]{ return i->limiterStop; })){
+			i->applyLimits();
+		}
+	});
+}
+
+void MegaClient::setFingerprintSkip(bool enabled){
+	this->impl->fingerprintSkip = enabled;
+}
+
+void MegaClient::setTransferJournal(TransferJournal* journal){
+	this->impl->journal = journal;
+}
+
+bool MegaClient::resumeTransfers(){
+	struct stat st;
+	bool res = true;
+
+	if (!impl->journal){
+		return false;
+	}
+
+	for (const TransferRecord& record : impl->journal->getRecords()){
+		const char* disk_path = record.diskPath.c_str();
+		const char* cloud_path = record.cloudPath.c_str();
+
+		// A transfer whose source is gone can never finish, so it is dropped instead of failing every resume.
+		if (record.type == TransferType::Download){
+			if (!impl->getNode(cloud_path)){
+				LOG(LEVEL_WARNING) << "MEGA: \"" << cloud_path << "\" no longer exists, dropping its download";
+				impl->forget(TransferType::Download, disk_path, cloud_path);
+				res = false;
+				continue;
+			}
+			res = download(cloud_path, disk_path) && res;
+		}
+		else{
+			if (::stat(disk_path, &st) != 0){
+				LOG(LEVEL_WARNING) << "MEGA: \"" << disk_path << "\" no longer exists, dropping its upload";
+				impl->forget(TransferType::Upload, disk_path, cloud_path);
+				res = false;
+				continue;
+			}
+			res = upload(disk_path, cloud_path) && res;
+		}
+	}
+	return res;
+}
+
 }
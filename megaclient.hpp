@@ -9,11 +9,26 @@
 #ifndef __CS_MEGACLIENT_HPP
 #define __CS_MEGACLIENT_HPP
 
+/**
+ * @brief The timeout of a request in milliseconds until enough latencies have been measured to derive one.
+ */
 #ifndef MEGA_WAIT_MS
 #define MEGA_WAIT_MS (10000)
 #endif
 
+/**
+ * @brief The most metadata requests that batch operations keep in flight at once.
+ */
+#ifndef MEGA_PIPELINE_DEPTH
+#define MEGA_PIPELINE_DEPTH (64)
+#endif
+
+#include "adaptivetimeout.hpp"
+#include "bandwidthlimiter.hpp"
 #include "baseclient.hpp"
+#include "config.hpp"
+#include "transferjournal.hpp"
+#include <cstdint>
 #include <optional>
 #include <memory>
 
@@ -31,31 +46,154 @@ enum MegaClientErrorCode{
 	IS_FILE,
 	IS_DIRECTORY,
 	PATH_NOT_FOUND,
+	SESSION_NOT_FOUND,
 	REQUEST_ERROR,
 	TRANSFER_ERROR,
 	SHOULDNEVERHAPPEN_ERROR
 };
 
+/**
+ * @brief The kinds of synchronous requests the MegaClient makes.
+ * Each kind has its own timeout, as their latencies differ by orders of magnitude.
+ */
+enum class MegaRequestType{
+	Login,
+	FetchNodes,
+	Mkdir,
+	Move,
+	Copy,
+	Remove,
+	Logout,
+	Count,
+};
+
 class MegaClient final : public BaseClient{
 public:
-	MegaClient();
+	/**
+	 * @brief Constructs a MegaClient.
+	 *
+	 * @param cacheDir A directory where the SDK keeps its local node database between runs, or nullptr to keep everything in memory.
+	 * It is created by login() if it does not exist.
+	 * With a cache, resuming an existing session only fetches the changes made since the last run instead of the whole account tree.
+	 * The measured request latencies are kept there as well, so the timeouts of requests made once per session adapt over several runs.
+	 */
+	MegaClient(const char* cacheDir = nullptr);
 	~MegaClient();
 
 	virtual bool login(const char* email, const char* password) override;
 	virtual bool mkdir(const char* dir) override;
 	virtual std::optional<std::vector<std::string>> readdir(const char* dir) override;
+	virtual bool readdirVisit(const char* dir, const ReaddirVisitor& visitor) override;
+	virtual std::optional<std::vector<DirEntry>> readdirPlus(const char* dir) override;
 	virtual bool stat(const char* path, struct stat* st) override;
 	virtual bool move(const char* oldPath, const char* newPath) override;
+	virtual bool copy(const char* srcPath, const char* dstPath) override;
 	virtual bool download(const char* cloudPath, const char* diskPath) override;
+	virtual bool downloadStream(const char* cloudPath, const DownloadSink& sink) override;
 	virtual bool upload(const char* diskPath, const char* cloudPath) override;
+	virtual std::future<bool> downloadAsync(const char* cloudPath, const char* diskPath, TransferCallback callback = nullptr) override;
+	virtual std::future<bool> uploadAsync(const char* diskPath, const char* cloudPath, TransferCallback callback = nullptr) override;
 	virtual bool remove(const char* path) override;
+	virtual bool removeRecursive(const char* path, const RemoveProgress& progress = nullptr) override;
 	virtual bool logout() override;
+	virtual std::vector<bool> mkdirAll(const std::vector<std::string>& dirs) override;
+	virtual std::vector<bool> moveMany(const std::vector<std::pair<std::string, std::string>>& moves) override;
+	virtual std::vector<bool> removeMany(const std::vector<std::string>& paths) override;
+
+	/**
+	 * @brief Logs in with a session saved by saveSession() instead of an email and password.
+	 * This skips the password-derived key computation and the full login round trips.
+	 * If the session has expired, this returns false and login() can be called instead.
+	 *
+	 * @param cf The ConfigFile the session was saved to.
+	 * @param key The key the session was saved under.
+	 *
+	 * @return True if the session was resumed, false if not.
+	 */
+	bool resumeSession(const ConfigFile& cf, const char* key = "megaSession");
+
+	/**
+	 * @brief Saves the current session so a later run can resume it with resumeSession().
+	 * The session token grants full access to the account, so the ConfigFile must be kept private.
+	 * Once a session has been saved, destroying the MegaClient calls suspend() instead of logout() so the session stays valid.
+	 *
+	 * @param cf The ConfigFile to save the session to.
+	 * @param key The key to save the session under.
+	 *
+	 * @return True if the session was saved, false if not.
+	 */
+	bool saveSession(ConfigFile& cf, const char* key = "megaSession");
+
+	/**
+	 * @brief Disconnects from the service without invalidating the session, keeping any saved session and the node cache usable.
+	 *
+	 * @return True if the client disconnected successfully, false if not.
+	 */
+	bool suspend();
 
 	const char* getLastError();
 	MegaClientErrorCode getLastErrorCode();
 	const char* getLastApiError();
 	void setUploadMsg(const char* msg);
 	void setDownloadMsg(const char* msg);
+
+	/**
+	 * @brief Splits large downloads into byte ranges that are fetched concurrently.
+	 * A single transfer tops out well below the capacity of a fast link, while several ranges in parallel can fill it.
+	 * The ranges are written straight into a preallocated file at their offsets.
+	 *
+	 * @param minSize Files at least this many bytes large are split. Smaller files use a single transfer.
+	 * @param nRanges The number of ranges to split a file into. A value of 1 or less disables splitting, which is the default.
+	 */
+	void setRangedDownload(uint64_t minSize, int nRanges);
+
+	/**
+	 * @brief Fixes the timeout of one kind of request instead of deriving it from measured latencies.
+	 * By default, every kind of request times out at a high percentile of its recent latencies plus a margin.
+	 *
+	 * @param type The kind of request.
+	 * @param millis The timeout in milliseconds, or 0 to go back to the adaptive timeout.
+	 */
+	void setRequestTimeout(MegaRequestType type, int millis);
+
+	/**
+	 * @brief Sets how requests are retried.
+	 * Requests failing with a temporary error are sent again after a backoff.
+	 * Requests that time out are not sent again, as they may still be pending. They are waited on again instead, once for every retry.
+	 */
+	void setRetryPolicy(const RetryPolicy& policy);
+
+	/**
+	 * @brief Records the progress of transfers in a journal so they can be resumed after a failure or a restart.
+	 * With a journal set, a failed download leaves its partial file behind, and downloading the same file again continues from the bytes already on disk.
+	 * Uploads are resumed by the SDK from its transfer cache, so they only skip the bytes already sent if this client was given a cache directory.
+	 * Failed transfers are retried according to the retry policy whether or not a journal is set.
+	 *
+	 * @param journal The journal to use, or nullptr to stop journaling. It must outlive this client or be unset first.
+	 */
+	void setTransferJournal(TransferJournal* journal);
+
+	/**
+	 * @brief Sets whether uploads look for a file with the same content in the account before sending any bytes.
+	 * The SDK-compatible fingerprint of the disk file is looked up. A match under the target name means there is nothing to do, and a match anywhere else is copied server-side.
+	 * This is on by default.
+	 */
+	void setFingerprintSkip(bool enabled);
+
+	/**
+	 * @brief Caps the aggregate upload and download rates of every transfer this client makes.
+	 * The limits are enforced by the SDK's own throttling and follow the limiter's schedule, which is checked every second.
+	 *
+	 * @param limiter The limiter to follow, or nullptr to remove the caps. It must outlive this client or be unset first.
+	 */
+	void setBandwidthLimiter(BandwidthLimiter* limiter);
+
+	/**
+	 * @brief Resumes every transfer left unfinished in the journal.
+	 *
+	 * @return True if every transfer finished, false if any failed or no journal is set. Failed transfers stay in the journal.
+	 */
+	bool resumeTransfers();
 private:
 	struct MegaClientImpl;
 	std::unique_ptr<MegaClientImpl> impl;
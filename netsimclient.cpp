@@ -0,0 +1,315 @@
+/** @file netsimclient.cpp
+ * @brief Client that simulates a slow or unreliable network in front of another client.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "netsimclient.hpp"
+#include "fs/file.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace CloudSync{
+
+struct NetSimClient::NetSimClientImpl{
+	/**
+	 * @brief The client requests are forwarded to.
+	 */
+	BaseClient& client;
+
+	/**
+	 * @brief The characteristics of the simulated link.
+	 */
+	NetSimConfig config;
+
+	/**
+	 * @brief Generates the jitter and failures.
+	 */
+	std::mt19937 rng;
+
+	/**
+	 * @brief The point in time at which the link has finished sending everything queued on it so far.
+	 */
+	std::chrono::steady_clock::time_point linkFree;
+
+	/**
+	 * @brief Governs the transfers before they reach the link, or nullptr for none.
+	 */
+	BandwidthLimiter* limiter = nullptr;
+
+	/**
+	 * @brief The token of the observer that passes the wrapped client's congestion signals on.
+	 */
+	uint64_t observer = 0;
+
+	/**
+	 * @brief Needed to prevent data races.
+	 */
+	std::mutex m;
+
+	NetSimClientImpl(BaseClient& client, const NetSimConfig& config): client(client), config(config), rng(config.seed), linkFree(std::chrono::steady_clock::now()){}
+
+	/**
+	 * @brief Waits out one round trip.
+	 *
+	 * @return True if the request should go through, false if it should be failed.
+	 */
+	bool roundTrip(){
+		int delayMs;
+		bool fail;
+
+		{
+			std::lock_guard<std::mutex> lock(m);
+			delayMs = config.latencyMs;
+			if (config.jitterMs > 0){
+				delayMs += std::uniform_int_distribution<int>(-config.jitterMs, config.jitterMs)(rng);
+			}
+			fail = config.failureRate > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < config.failureRate;
+		}
+
+		if (delayMs > 0){
+			std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+		}
+		if (fail){
+			LOG(LEVEL_DEBUG) << "NetSimClient: Simulating a failed request";
+		}
+		return !fail;
+	}
+
+	/**
+	 * @brief Waits out one round trip per wave of a pipelined batch, as every request in a wave is in flight at once.
+	 *
+	 * @return True if the batch should go through, false if it should be failed.
+	 */
+	bool roundTrips(size_t waves){
+		for (size_t i = 0; i < waves; ++i){
+			if (!roundTrip()){
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Waits until the bandwidth limiter lets the given number of bytes through, and then until they have gone through the link.
+	 * Concurrent transfers queue up behind each other, so together they never exceed the bandwidth.
+	 */
+	void sendBytes(uint64_t bytes, TransferType type){
+		std::chrono::steady_clock::time_point done;
+		BandwidthLimiter* l;
+
+		{
+			std::lock_guard<std::mutex> lock(m);
+			l = limiter;
+		}
+		if (l){
+			l->acquire(type, bytes);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m);
+			if (config.bytesPerSecond == 0){
+				return;
+			}
+			std::chrono::duration<double> duration(static_cast<double>(bytes) / config.bytesPerSecond);
+			done = std::max(linkFree, std::chrono::steady_clock::now()) + std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration);
+			linkFree = done;
+		}
+		std::this_thread::sleep_until(done);
+	}
+};
+
+/**
+ * @brief Gets the size of a file on disk, or 0 if it cannot be determined.
+ */
+static uint64_t disk_size(const char* path){
+	try{
+		return fs::size(path);
+	}
+	catch (std::exception& e){
+		return 0;
+	}
+}
+
+NetSimClient::NetSimClient(BaseClient& client, const NetSimConfig& config): impl(std::make_unique<NetSimClientImpl>(client, config)){
+	// Progress is reported by this client instead, as it is what holds the bytes back.
+	TransferObserver observer;
+	observer.onCongestion = [this]{ reportCongestion(); };
+	impl->observer = client.addTransferObserver(std::move(observer));
+}
+
+NetSimClient::~NetSimClient(){
+	impl->client.removeTransferObserver(impl->observer);
+}
+
+bool NetSimClient::login(const char* username, const char* password){
+	return impl->roundTrip() && impl->client.login(username, password);
+}
+
+bool NetSimClient::mkdir(const char* dir){
+	return impl->roundTrip() && impl->client.mkdir(dir);
+}
+
+std::optional<std::vector<std::string>> NetSimClient::readdir(const char* dir){
+	if (!impl->roundTrip()){
+		return std::nullopt;
+	}
+	return impl->client.readdir(dir);
+}
+
+std::optional<std::vector<DirEntry>> NetSimClient::readdirPlus(const char* dir){
+	// Forwarded as a single request so a backend with a native listing call is simulated faithfully.
+	if (!impl->roundTrip()){
+		return std::nullopt;
+	}
+	return impl->client.readdirPlus(dir);
+}
+
+bool NetSimClient::readdirVisit(const char* dir, const ReaddirVisitor& visitor){
+	return impl->roundTrip() && impl->client.readdirVisit(dir, visitor);
+}
+
+bool NetSimClient::stat(const char* path, struct stat* st){
+	return impl->roundTrip() && impl->client.stat(path, st);
+}
+
+bool NetSimClient::move(const char* old_path, const char* new_path){
+	return impl->roundTrip() && impl->client.move(old_path, new_path);
+}
+
+bool NetSimClient::copy(const char* src_path, const char* dst_path){
+	// The wrapped client decides whether the bytes cross the link, so a server-side copy costs one round trip.
+	return impl->roundTrip() && impl->client.copy(src_path, dst_path);
+}
+
+bool NetSimClient::download(const char* cloud_path, const char* disk_path){
+	std::string tmpPath;
+
+	if (!impl->roundTrip()){
+		return false;
+	}
+
+	// The data is streamed into a file next to the destination, each chunk held back until the link could have carried it, so the file only appears once the whole transfer could have arrived.
+	try{
+		std::string dir = fs::parentDir(disk_path);
+		std::pair<std::string, std::ofstream> tmpFile = fs::makeTemp(dir.empty() ? "." : dir.c_str());
+
+		tmpPath = tmpFile.first;
+		if (!impl->client.downloadStream(cloud_path, [this, &tmpFile](const unsigned char* buf, size_t len){
+			impl->sendBytes(len, TransferType::Download);
+			reportProgress(len);
+			tmpFile.second.write(reinterpret_cast<const char*>(buf), len);
+			return tmpFile.second.good();
+		})){
+			fs::remove(tmpPath.c_str());
+			return false;
+		}
+		tmpFile.second.close();
+		if (!tmpFile.second.good()){
+			LOG(LEVEL_DEBUG) << "NetSimClient: I/O error writing to \"" << tmpPath << "\"";
+			fs::remove(tmpPath.c_str());
+			return false;
+		}
+		fs::move(tmpPath.c_str(), disk_path);
+	}
+	catch (std::exception& e){
+		LOG(LEVEL_DEBUG) << "NetSimClient: Download of \"" << cloud_path << "\" failed: " << e.what();
+		if (!tmpPath.empty()){
+			fs::remove(tmpPath.c_str());
+		}
+		return false;
+	}
+	return true;
+}
+
+bool NetSimClient::downloadStream(const char* cloud_path, const DownloadSink& sink){
+	if (!impl->roundTrip()){
+		return false;
+	}
+	return impl->client.downloadStream(cloud_path, [this, &sink](const unsigned char* buf, size_t len){
+		impl->sendBytes(len, TransferType::Download);
+		reportProgress(len);
+		return sink(buf, len);
+	});
+}
+
+bool NetSimClient::upload(const char* disk_path, const char* cloud_path){
+	if (!impl->roundTrip()){
+		return false;
+	}
+	uint64_t size = disk_size(disk_path);
+	impl->sendBytes(size, TransferType::Upload);
+	reportProgress(size);
+	return impl->client.upload(disk_path, cloud_path);
+}
+
+bool NetSimClient::uploadStream(const UploadSource& source, const char* cloud_path){
+	if (!impl->roundTrip()){
+		return false;
+	}
+	// Each chunk is held back until the link could have carried it.
+	return impl->client.uploadStream([this, &source](unsigned char* buf, size_t len){
+		size_t ret = source(buf, len);
+		impl->sendBytes(ret, TransferType::Upload);
+		reportProgress(ret);
+		return ret;
+	}, cloud_path);
+}
+
+bool NetSimClient::remove(const char* path){
+	return impl->roundTrip() && impl->client.remove(path);
+}
+
+bool NetSimClient::logout(){
+	return impl->roundTrip() && impl->client.logout();
+}
+
+std::vector<bool> NetSimClient::mkdirAll(const std::vector<std::string>& dirs){
+	if (!impl->roundTrips(depthWaves(std::vector<std::string_view>(dirs.begin(), dirs.end()), false).size())){
+		return std::vector<bool>(dirs.size(), false);
+	}
+	return impl->client.mkdirAll(dirs);
+}
+
+std::vector<bool> NetSimClient::moveMany(const std::vector<std::pair<std::string, std::string>>& moves){
+	std::vector<std::string_view> sources;
+
+	for (const auto& m : moves){
+		sources.push_back(m.first);
+	}
+	if (!impl->roundTrips(depthWaves(sources, true).size())){
+		return std::vector<bool>(moves.size(), false);
+	}
+	return impl->client.moveMany(moves);
+}
+
+std::vector<bool> NetSimClient::removeMany(const std::vector<std::string>& paths){
+	if (!impl->roundTrips(depthWaves(std::vector<std::string_view>(paths.begin(), paths.end()), true).size())){
+		return std::vector<bool>(paths.size(), false);
+	}
+	return impl->client.removeMany(paths);
+}
+
+void NetSimClient::setConfig(const NetSimConfig& config){
+	std::lock_guard<std::mutex> lock(impl->m);
+	impl->config = config;
+}
+
+NetSimConfig NetSimClient::getConfig(){
+	std::lock_guard<std::mutex> lock(impl->m);
+	return impl->config;
+}
+
+void NetSimClient::setBandwidthLimiter(BandwidthLimiter* limiter){
+	std::lock_guard<std::mutex> lock(impl->m);
+	impl->limiter = limiter;
+}
+
+}
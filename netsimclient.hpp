@@ -0,0 +1,111 @@
+/** @file netsimclient.hpp
+ * @brief Client that simulates a slow or unreliable network in front of another client.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#ifndef __CS_NETSIMCLIENT_HPP
+#define __CS_NETSIMCLIENT_HPP
+
+#include "bandwidthlimiter.hpp"
+#include "baseclient.hpp"
+#include <cstdint>
+#include <memory>
+
+namespace CloudSync{
+
+/**
+ * @brief The characteristics of the simulated network link.
+ */
+struct NetSimConfig{
+	/**
+	 * @brief The round trip time added to every request in milliseconds.
+	 */
+	int latencyMs = 0;
+
+	/**
+	 * @brief The most that a request's latency can randomly deviate from latencyMs in milliseconds.
+	 */
+	int jitterMs = 0;
+
+	/**
+	 * @brief The bandwidth of the link in bytes per second, or 0 for unlimited.
+	 * This is shared between all transfers in flight, like a real link.
+	 */
+	uint64_t bytesPerSecond = 0;
+
+	/**
+	 * @brief The probability (from 0 to 1) that a request fails without reaching the wrapped client.
+	 */
+	double failureRate = 0;
+
+	/**
+	 * @brief The seed for the jitter and failure random number generator, so runs can be reproduced.
+	 */
+	unsigned seed = 0;
+};
+
+/**
+ * @brief A BaseClient that forwards every request to another client, adding latency, jitter, bandwidth limits, and random failures on the way.
+ * Wrapping a LocalDirClient reproduces the behavior of a real link without the network.
+ * Recursive removes use the default BaseClient::removeRecursive() through this client, so every listing and removal pays for its own round trip.
+ * This class is thread-safe as long as the wrapped client is.
+ */
+class NetSimClient final : public BaseClient{
+public:
+	/**
+	 * @brief Constructs a NetSimClient.
+	 *
+	 * @param client The client to forward requests to.
+	 * It must outlive the NetSimClient.
+	 * @param config The characteristics of the simulated link.
+	 */
+	NetSimClient(BaseClient& client, const NetSimConfig& config = NetSimConfig());
+	~NetSimClient();
+
+	virtual bool login(const char* username, const char* password) override;
+	virtual bool mkdir(const char* dir) override;
+	virtual std::optional<std::vector<std::string>> readdir(const char* dir) override;
+	virtual bool readdirVisit(const char* dir, const ReaddirVisitor& visitor) override;
+	virtual std::optional<std::vector<DirEntry>> readdirPlus(const char* dir) override;
+	virtual bool stat(const char* path, struct stat* st) override;
+	virtual bool move(const char* oldPath, const char* newPath) override;
+	virtual bool copy(const char* srcPath, const char* dstPath) override;
+	virtual bool download(const char* cloudPath, const char* diskPath) override;
+	virtual bool downloadStream(const char* cloudPath, const DownloadSink& sink) override;
+	virtual bool upload(const char* diskPath, const char* cloudPath) override;
+	virtual bool uploadStream(const UploadSource& source, const char* cloudPath) override;
+	virtual bool remove(const char* path) override;
+	virtual bool logout() override;
+	virtual std::vector<bool> mkdirAll(const std::vector<std::string>& dirs) override;
+	virtual std::vector<bool> moveMany(const std::vector<std::pair<std::string, std::string>>& moves) override;
+	virtual std::vector<bool> removeMany(const std::vector<std::string>& paths) override;
+
+	/**
+	 * @brief Changes the characteristics of the simulated link.
+	 * Requests already in flight keep the old ones.
+	 */
+	void setConfig(const NetSimConfig& config);
+
+	/**
+	 * @brief Gets the characteristics of the simulated link.
+	 */
+	NetSimConfig getConfig();
+
+	/**
+	 * @brief Puts a bandwidth limiter in front of the simulated link, so its effect can be observed without the network.
+	 *
+	 * @param limiter The limiter to use, or nullptr for none. It must outlive this client or be unset first.
+	 */
+	void setBandwidthLimiter(BandwidthLimiter* limiter);
+
+private:
+	struct NetSimClientImpl;
+	std::unique_ptr<NetSimClientImpl> impl;
+};
+
+}
+
+#endif
@@ -0,0 +1,394 @@
+/** @file remoteindex.cpp
+ * @brief A snapshot of a remote tree in a compact binary file that can be memory-mapped.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "remoteindex.hpp"
+#include "fs/file.hpp"
+#include "fs/ioexception.hpp"
+#include "fs/mappedfile.hpp"
+#include "lnthrow.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <vector>
+
+namespace CloudSync {
+
+constexpr const char INDEX_MAGIC[8] = { 'C', 'S', 'R', 'I', 'D', 'X', '\0', '\0' };
+constexpr uint32_t INDEX_VERSION = 1;
+
+/**
+ * @brief Written as is, so an index from a machine of the other endianness is rejected instead of misread.
+ */
+constexpr uint32_t INDEX_BYTE_ORDER = 0x01020304;
+
+/**
+ * @brief The start of an index file. It is followed by
+ * ```
+ * uint64_t size[count], int64_t mtime[count], uint64_t nameOffset[count], uint64_t fingerprintOffset[count],
+ * uint32_t parent[count], uint32_t firstChild[count], uint32_t childCount[count], uint32_t mode[count], uint32_t nameLength[count], uint32_t fingerprintLength[count],
+ * char pool[poolLength]
+ * ```
+ * The 8-byte columns come first so that every column is naturally aligned.
+ */
+struct IndexHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t count;
+	uint32_t reserved;
+	uint64_t poolLength;
+};
+static_assert(sizeof(IndexHeader) == 32, "IndexHeader must not have padding");
+
+/**
+ * @brief The number of bytes every entry takes up in the columns.
+ */
+constexpr uint64_t ENTRY_LEN = 4 * sizeof(uint64_t) + 6 * sizeof(uint32_t);
+
+/**
+ * @brief An entry of an index that is being built.
+ */
+struct BuildEntry {
+	std::string name;
+	std::string fingerprint;
+	uint64_t size;
+	int64_t mtime;
+	uint32_t mode;
+	uint32_t parent;
+	uint32_t firstChild = 0;
+	uint32_t childCount = 0;
+};
+
+template <typename T>
+static void put_column(std::vector<unsigned char>& out, size_t& pos, const std::vector<BuildEntry>& entries, T (*get)(const BuildEntry&)) {
+	for (const BuildEntry& e : entries) {
+		T val = get(e);
+		std::memcpy(out.data() + pos, &val, sizeof(val));
+		pos += sizeof(val);
+	}
+}
+
+struct RemoteIndex::RemoteIndexImpl {
+	/**
+	 * @brief The file the index was opened from, if it was.
+	 */
+	std::optional<fs::MappedFile> file;
+
+	/**
+	 * @brief The contents of an index that was built in memory.
+	 */
+	std::vector<unsigned char> owned;
+
+	/**
+	 * @brief The serialized index, pointing into either file or owned.
+	 */
+	const unsigned char* data = nullptr;
+	size_t len = 0;
+
+	uint32_t count = 0;
+	const uint64_t* sizes = nullptr;
+	const int64_t* mtimes = nullptr;
+	const uint64_t* nameOffsets = nullptr;
+	const uint64_t* fingerprintOffsets = nullptr;
+	const uint32_t* parents = nullptr;
+	const uint32_t* firstChildren = nullptr;
+	const uint32_t* childCounts = nullptr;
+	const uint32_t* modes = nullptr;
+	const uint32_t* nameLengths = nullptr;
+	const uint32_t* fingerprintLengths = nullptr;
+	const char* pool = nullptr;
+
+	/**
+	 * @brief Points the columns into data after checking that it is a valid index.
+	 * The checks guarantee that no accessor can read out of bounds or loop forever, however corrupt the file is.
+	 *
+	 * @exception fs::IOException The data is not a valid index.
+	 */
+	void attach(const char* source) {
+		IndexHeader header;
+
+		if (len < sizeof(header)) {
+			lnthrow(fs::IOException, std::string("\"") + source + "\" is too short to be a remote index");
+		}
+		std::memcpy(&header, data, sizeof(header));
+		if (std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.byteOrder != INDEX_BYTE_ORDER) {
+			lnthrow(fs::IOException, std::string("\"") + source + "\" is not a remote index");
+		}
+		if (header.version != INDEX_VERSION) {
+			lnthrow(fs::IOException, std::string("\"") + source + "\" has unsupported remote index version " + std::to_string(header.version));
+		}
+		if (header.count == 0 || header.count == NONE || len - sizeof(header) < header.count * ENTRY_LEN || len - sizeof(header) - header.count * ENTRY_LEN != header.poolLength) {
+			lnthrow(fs::IOException, std::string("\"") + source + "\" is truncated or corrupt");
+		}
+
+		count = header.count;
+		const unsigned char* ptr = data + sizeof(header);
+		auto column = [&](auto& col) {
+			col = reinterpret_cast<std::remove_reference_t<decltype(col)>>(ptr);
+			ptr += count * sizeof(*col);
+		};
+		column(sizes);
+		column(mtimes);
+		column(nameOffsets);
+		column(fingerprintOffsets);
+		column(parents);
+		column(firstChildren);
+		column(childCounts);
+		column(modes);
+		column(nameLengths);
+		column(fingerprintLengths);
+		pool = reinterpret_cast<const char*>(ptr);
+
+		for (uint32_t i = 0; i < count; ++i) {
+			// Parents come before their children breadth-first, which also rules out cycles.
+			bool parentOk = i == 0 ? parents[i] == NONE : parents[i] < i;
+			if (!parentOk ||
+				nameOffsets[i] > header.poolLength || header.poolLength - nameOffsets[i] < nameLengths[i] ||
+				fingerprintOffsets[i] > header.poolLength || header.poolLength - fingerprintOffsets[i] < fingerprintLengths[i] ||
+				firstChildren[i] > count || count - firstChildren[i] < childCounts[i]) {
+				lnthrow(fs::IOException, std::string("\"") + source + "\" has a corrupt entry at index " + std::to_string(i));
+			}
+		}
+	}
+};
+
+RemoteIndex::RemoteIndex(): impl(std::make_unique<RemoteIndexImpl>()) {}
+
+RemoteIndex::RemoteIndex(const char* path): impl(std::make_unique<RemoteIndexImpl>()) {
+	this->impl->file.emplace(path);
+	this->impl->data = this->impl->file->data();
+	this->impl->len = this->impl->file->size();
+	this->impl->attach(path);
+}
+
+RemoteIndex::RemoteIndex(RemoteIndex&& other) noexcept = default;
+
+RemoteIndex& RemoteIndex::operator=(RemoteIndex&& other) noexcept = default;
+
+RemoteIndex::~RemoteIndex() = default;
+
+std::optional<RemoteIndex> RemoteIndex::build(BaseClient& client, const char* root) {
+	std::vector<BuildEntry> entries;
+	// Directories that still have to be listed, along with their full paths.
+	std::queue<std::pair<uint32_t, std::string>> dirs;
+	BuildEntry rootEntry;
+	struct stat st;
+	uint64_t poolLength = 0;
+
+	if (!client.stat(root, &st) || !S_ISDIR(st.st_mode)) {
+		LOG(LEVEL_DEBUG) << "\"" << root << "\" is not a directory";
+		return std::nullopt;
+	}
+	rootEntry.size = st.st_size;
+	rootEntry.mtime = st.st_mtime;
+	rootEntry.mode = st.st_mode;
+	rootEntry.parent = NONE;
+	entries.push_back(std::move(rootEntry));
+	dirs.emplace(0, root);
+
+	while (!dirs.empty()) {
+		auto [index, dir] = std::move(dirs.front());
+		std::optional<std::vector<DirEntry>> listing = client.readdirPlus(dir.c_str());
+
+		dirs.pop();
+		if (!listing) {
+			LOG(LEVEL_DEBUG) << "Failed to list \"" << dir << "\"";
+			return std::nullopt;
+		}
+		if (entries.size() + listing->size() >= NONE) {
+			LOG(LEVEL_DEBUG) << "\"" << root << "\" has too many entries to index";
+			return std::nullopt;
+		}
+
+		std::sort(listing->begin(), listing->end(), [](const DirEntry& a, const DirEntry& b) {
+			return a.name < b.name;
+		});
+		entries[index].firstChild = entries.size();
+		entries[index].childCount = listing->size();
+		for (DirEntry& de : listing.value()) {
+			BuildEntry e;
+			e.size = de.st.st_size;
+			e.mtime = de.st.st_mtime;
+			e.mode = de.st.st_mode;
+			e.parent = index;
+			if (S_ISDIR(e.mode)) {
+				std::string path = dir;
+				if (path.empty() || path.back() != '/') {
+					path += '/';
+				}
+				dirs.emplace(entries.size(), path + de.name);
+			}
+			e.name = std::move(de.name);
+			e.fingerprint = std::move(de.fingerprint);
+			poolLength += e.name.size() + e.fingerprint.size();
+			entries.push_back(std::move(e));
+		}
+	}
+
+	RemoteIndex ret;
+	RemoteIndexImpl& r = *ret.impl;
+	IndexHeader header = {};
+	size_t pos = sizeof(header);
+	uint64_t poolPos = 0;
+
+	std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header.version = INDEX_VERSION;
+	header.byteOrder = INDEX_BYTE_ORDER;
+	header.count = entries.size();
+	header.poolLength = poolLength;
+
+	r.owned.resize(sizeof(header) + entries.size() * ENTRY_LEN + poolLength);
+	std::memcpy(r.owned.data(), &header, sizeof(header));
+	put_column<uint64_t>(r.owned, pos, entries, [](const BuildEntry& e) { return e.size; });
+	put_column<int64_t>(r.owned, pos, entries, [](const BuildEntry& e) { return e.mtime; });
+	for (const BuildEntry& e : entries) {
+		std::memcpy(r.owned.data() + pos, &poolPos, sizeof(poolPos));
+		pos += sizeof(poolPos);
+		poolPos += e.name.size() + e.fingerprint.size();
+	}
+	poolPos = 0;
+	for (const BuildEntry& e : entries) {
+		uint64_t fpPos = poolPos + e.name.size();
+		std::memcpy(r.owned.data() + pos, &fpPos, sizeof(fpPos));
+		pos += sizeof(fpPos);
+		poolPos += e.name.size() + e.fingerprint.size();
+	}
+	put_column<uint32_t>(r.owned, pos, entries, [](const BuildEntry& e) { return e.parent; });
+	put_column<uint32_t>(r.owned, pos, entries, [](const BuildEntry& e) { return e.firstChild; });
+	put_column<uint32_t>(r.owned, pos, entries, [](const BuildEntry& e) { return e.childCount; });
+	put_column<uint32_t>(r.owned, pos, entries, [](const BuildEntry& e) { return e.mode; });
+	put_column<uint32_t>(r.owned, pos, entries, [](const BuildEntry& e) { return static_cast<uint32_t>(e.name.size()); });
+	put_column<uint32_t>(r.owned, pos, entries, [](const BuildEntry& e) { return static_cast<uint32_t>(e.fingerprint.size()); });
+	for (const BuildEntry& e : entries) {
+		std::memcpy(r.owned.data() + pos, e.name.data(), e.name.size());
+		pos += e.name.size();
+		std::memcpy(r.owned.data() + pos, e.fingerprint.data(), e.fingerprint.size());
+		pos += e.fingerprint.size();
+	}
+
+	r.data = r.owned.data();
+	r.len = r.owned.size();
+	r.attach(root);
+	LOG(LEVEL_DEBUG) << "Indexed " << entries.size() << " entries under \"" << root << "\"";
+	return ret;
+}
+
+void RemoteIndex::save(const char* path) const {
+	std::string tmpPath = std::string(path) + ".tmp";
+	std::ofstream ofs(tmpPath, std::ios_base::binary | std::ios_base::trunc);
+
+	ofs.write(reinterpret_cast<const char*>(this->impl->data), this->impl->len);
+	ofs.close();
+	if (!ofs) {
+		std::remove(tmpPath.c_str());
+		lnthrow(fs::IOException, std::string("Failed to write remote index \"") + tmpPath + "\"");
+	}
+
+	// Without the syncs, a crash soon after the rename can leave the new name pointing at a file whose data never reached the disk.
+	try {
+		fs::sync(tmpPath.c_str());
+		std::filesystem::rename(tmpPath, path);
+	}
+	catch (std::exception& e) {
+		std::remove(tmpPath.c_str());
+		lnthrow(fs::IOException, std::string("Failed to replace remote index \"") + path + "\"", e);
+	}
+	std::string dir = fs::parentDir(path);
+	fs::sync(dir.empty() ? "." : dir.c_str());
+}
+
+uint32_t RemoteIndex::count() const noexcept {
+	return this->impl->count;
+}
+
+std::string_view RemoteIndex::name(uint32_t i) const noexcept {
+	return std::string_view(this->impl->pool + this->impl->nameOffsets[i], this->impl->nameLengths[i]);
+}
+
+std::string_view RemoteIndex::fingerprint(uint32_t i) const noexcept {
+	return std::string_view(this->impl->pool + this->impl->fingerprintOffsets[i], this->impl->fingerprintLengths[i]);
+}
+
+uint32_t RemoteIndex::parent(uint32_t i) const noexcept {
+	return this->impl->parents[i];
+}
+
+uint64_t RemoteIndex::size(uint32_t i) const noexcept {
+	return this->impl->sizes[i];
+}
+
+int64_t RemoteIndex::mtime(uint32_t i) const noexcept {
+	return this->impl->mtimes[i];
+}
+
+uint32_t RemoteIndex::mode(uint32_t i) const noexcept {
+	return this->impl->modes[i];
+}
+
+bool RemoteIndex::isDirectory(uint32_t i) const noexcept {
+	return S_ISDIR(this->impl->modes[i]);
+}
+
+std::pair<uint32_t, uint32_t> RemoteIndex::children(uint32_t i) const noexcept {
+	return { this->impl->firstChildren[i], this->impl->firstChildren[i] + this->impl->childCounts[i] };
+}
+
+std::string RemoteIndex::path(uint32_t i) const {
+	std::vector<std::string_view> components;
+	std::string ret;
+
+	for (; i != 0; i = this->impl->parents[i]) {
+		components.push_back(this->name(i));
+	}
+	if (components.empty()) {
+		return "/";
+	}
+	for (auto it = components.rbegin(); it != components.rend(); ++it) {
+		ret += '/';
+		ret += *it;
+	}
+	return ret;
+}
+
+uint32_t RemoteIndex::find(const char* path) const noexcept {
+	std::string_view rest = path;
+	uint32_t cur = 0;
+
+	while (!rest.empty()) {
+		size_t slash = rest.find('/');
+		std::string_view component = rest.substr(0, slash);
+		rest = slash == std::string_view::npos ? std::string_view() : rest.substr(slash + 1);
+		if (component.empty() || component == ".") {
+			continue;
+		}
+
+		auto [first, last] = this->children(cur);
+		uint32_t lo = first;
+		uint32_t hi = last;
+		while (lo < hi) {
+			uint32_t mid = lo + (hi - lo) / 2;
+			if (this->name(mid) < component) {
+				lo = mid + 1;
+			}
+			else {
+				hi = mid;
+			}
+		}
+		if (lo == last || this->name(lo) != component) {
+			return NONE;
+		}
+		cur = lo;
+	}
+	return cur;
+}
+
+}
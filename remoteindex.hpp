@@ -0,0 +1,129 @@
+/** @file remoteindex.hpp
+ * @brief A snapshot of a remote tree in a compact binary file that can be memory-mapped.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#ifndef __CS_REMOTEINDEX_HPP
+#define __CS_REMOTEINDEX_HPP
+
+#include "baseclient.hpp"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace CloudSync{
+
+/**
+ * @brief A read-only snapshot of a remote directory tree.
+ *
+ * Entries are numbered breadth-first. Entry 0 is the root of the snapshot, and the children of every directory are numbered consecutively in byte-wise order of their names.
+ * The attributes are stored as one array per field with the names and fingerprints in a shared string pool, so a scan over sizes or mtimes touches nothing but sizes or mtimes.
+ * The file is this exact layout in native byte order, so opening one maps it into memory instead of parsing it.
+ *
+ * This class is thread-safe, as it cannot be modified.
+ */
+class RemoteIndex {
+public:
+	/**
+	 * @brief The parent of the root, and the value of a missing entry.
+	 */
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	/**
+	 * @brief Lists a remote tree into a new index.
+	 * This makes one readdirPlus() call per directory.
+	 *
+	 * @param client The client to list the tree through.
+	 * @param root The directory to snapshot.
+	 *
+	 * @return The index, or std::nullopt if the root is not a directory or a listing failed.
+	 */
+	static std::optional<RemoteIndex> build(BaseClient& client, const char* root);
+
+	/**
+	 * @brief Opens an index that was written with save().
+	 * The file is mapped into memory, so it must not be modified while it is open.
+	 *
+	 * @param path The path of the index.
+	 *
+	 * @exception fs::NotFoundException The file does not exist.
+	 * @exception fs::IOException The file could not be read or is not a valid index.
+	 */
+	RemoteIndex(const char* path);
+
+	RemoteIndex(RemoteIndex&& other) noexcept;
+	RemoteIndex& operator=(RemoteIndex&& other) noexcept;
+	~RemoteIndex();
+
+	/**
+	 * @brief Writes the index to a file.
+	 * The file is replaced atomically, so an index that is open elsewhere stays intact.
+	 * It is synced to disk first, so a crash leaves either the old or the new index.
+	 *
+	 * @param path The path to write to.
+	 *
+	 * @exception fs::IOException There was an I/O error writing the file.
+	 */
+	void save(const char* path) const;
+
+	/**
+	 * @brief Returns the number of entries, including the root.
+	 */
+	uint32_t count() const noexcept;
+
+	/**
+	 * @brief Returns the filename of an entry. The root's name is empty.
+	 * The string_view is valid for as long as the index.
+	 */
+	std::string_view name(uint32_t i) const noexcept;
+
+	/**
+	 * @brief Returns the fingerprint of an entry, or an empty string if the cloud service did not provide one.
+	 * The string_view is valid for as long as the index.
+	 */
+	std::string_view fingerprint(uint32_t i) const noexcept;
+
+	/**
+	 * @brief Returns the parent of an entry, or NONE for the root.
+	 */
+	uint32_t parent(uint32_t i) const noexcept;
+
+	uint64_t size(uint32_t i) const noexcept;
+	int64_t mtime(uint32_t i) const noexcept;
+	uint32_t mode(uint32_t i) const noexcept;
+	bool isDirectory(uint32_t i) const noexcept;
+
+	/**
+	 * @brief Returns the children of an entry as a [first, last) range of indices. The range is empty for a file.
+	 */
+	std::pair<uint32_t, uint32_t> children(uint32_t i) const noexcept;
+
+	/**
+	 * @brief Returns the path of an entry relative to the root of the index, such as "/a/b". The root's path is "/".
+	 */
+	std::string path(uint32_t i) const;
+
+	/**
+	 * @brief Looks up an entry by its path relative to the root of the index.
+	 * This does a binary search per path component.
+	 *
+	 * @return The entry, or NONE if there is no entry at that path.
+	 */
+	uint32_t find(const char* path) const noexcept;
+
+private:
+	RemoteIndex();
+
+	struct RemoteIndexImpl;
+	std::unique_ptr<RemoteIndexImpl> impl;
+};
+
+}
+
+#endif
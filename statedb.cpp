@@ -0,0 +1,352 @@
+/** @file statedb.cpp
+ * @brief Remembers the state of every synced file, so unchanged files can be skipped without reading them.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "statedb.hpp"
+#include "fs/file.hpp"
+#include "fs/ioexception.hpp"
+#include "fs/mappedfile.hpp"
+#include "fs/notfoundexception.hpp"
+#include "lnthrow.hpp"
+#include "logger.hpp"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string_view>
+
+namespace CloudSync {
+
+constexpr const char STATEDB_MAGIC[8] = { 'C', 'S', 'S', 'T', 'A', 'T', 'E', '\0' };
+constexpr uint32_t STATEDB_VERSION = 1;
+
+/**
+ * @brief Written as is, so a database from a machine of the other endianness is rejected instead of misread.
+ */
+constexpr uint32_t STATEDB_BYTE_ORDER = 0x01020304;
+
+/**
+ * @brief The start of a database file. It is followed by StateRecord[count] sorted by path, then char pool[poolLength].
+ */
+struct StateHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t count;
+	uint64_t poolLength;
+};
+static_assert(sizeof(StateHeader) == 32, "StateHeader must not have padding");
+
+struct StateRecord {
+	uint64_t pathOffset;
+	uint64_t hashOffset;
+	uint32_t pathLength;
+	uint32_t hashLength;
+	uint64_t inode;
+	uint64_t size;
+	int64_t mtimeNs;
+	int64_t ctimeNs;
+};
+static_assert(sizeof(StateRecord) == 56, "StateRecord must not have padding");
+
+static int64_t to_ns(const struct timespec& ts) {
+	return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+FileState FileState::fromStat(const struct stat& st, std::string hash) {
+	FileState ret;
+	ret.inode = st.st_ino;
+	ret.size = st.st_size;
+	ret.mtimeNs = to_ns(st.st_mtim);
+	ret.ctimeNs = to_ns(st.st_ctim);
+	ret.hash = std::move(hash);
+	return ret;
+}
+
+bool FileState::matches(const struct stat& st) const {
+	return inode == static_cast<uint64_t>(st.st_ino) && size == static_cast<uint64_t>(st.st_size) && mtimeNs == to_ns(st.st_mtim) && ctimeNs == to_ns(st.st_ctim);
+}
+
+struct StateDatabase::StateDatabaseImpl {
+	std::string path;
+
+	/**
+	 * @brief The database as of the last flush, or std::nullopt if there is no file yet.
+	 */
+	std::optional<fs::MappedFile> file;
+	const StateRecord* records = nullptr;
+	uint64_t count = 0;
+	const char* pool = nullptr;
+
+	/**
+	 * @brief Changes since the last flush. std::nullopt marks a removal.
+	 * This is ordered the same way as the records, so flush() can merge the two.
+	 */
+	std::map<std::string, std::optional<FileState>, std::less<>> pending;
+
+	/**
+	 * @brief Needed to prevent data races.
+	 */
+	mutable std::mutex m;
+
+	std::string_view recordPath(const StateRecord& r) const {
+		return std::string_view(pool + r.pathOffset, r.pathLength);
+	}
+
+	FileState toState(const StateRecord& r) const {
+		FileState ret;
+		ret.inode = r.inode;
+		ret.size = r.size;
+		ret.mtimeNs = r.mtimeNs;
+		ret.ctimeNs = r.ctimeNs;
+		ret.hash.assign(pool + r.hashOffset, r.hashLength);
+		return ret;
+	}
+
+	/**
+	 * @brief Binary searches the file for a path.
+	 *
+	 * @return The record, or nullptr if the path is not in the file.
+	 */
+	const StateRecord* findRecord(std::string_view key) const {
+		uint64_t lo = 0;
+		uint64_t hi = count;
+
+		while (lo < hi) {
+			uint64_t mid = lo + (hi - lo) / 2;
+			if (recordPath(records[mid]) < key) {
+				lo = mid + 1;
+			}
+			else {
+				hi = mid;
+			}
+		}
+		return lo < count && recordPath(records[lo]) == key ? &records[lo] : nullptr;
+	}
+
+	/**
+	 * @brief Looks up a path, taking pending changes into account. The mutex must be held.
+	 */
+	std::optional<FileState> lookup(std::string_view key) const {
+		auto it = pending.find(key);
+		if (it != pending.end()) {
+			return it->second;
+		}
+		const StateRecord* r = findRecord(key);
+		if (!r) {
+			return std::nullopt;
+		}
+		return toState(*r);
+	}
+
+	/**
+	 * @brief Maps the file at path, or leaves the database empty if there is none.
+	 *
+	 * @exception fs::IOException The file could not be read or is not a state database.
+	 */
+	void open() {
+		StateHeader header;
+
+		file.reset();
+		records = nullptr;
+		count = 0;
+		pool = nullptr;
+
+		try {
+			file.emplace(path.c_str());
+		}
+		catch (fs::NotFoundException&) {
+			return;
+		}
+
+		if (file->size() < sizeof(header)) {
+			lnthrow(fs::IOException, "\"" + path + "\" is too short to be a state database");
+		}
+		std::memcpy(&header, file->data(), sizeof(header));
+		if (std::memcmp(header.magic, STATEDB_MAGIC, sizeof(STATEDB_MAGIC)) != 0 || header.byteOrder != STATEDB_BYTE_ORDER) {
+			lnthrow(fs::IOException, "\"" + path + "\" is not a state database");
+		}
+		if (header.version != STATEDB_VERSION) {
+			lnthrow(fs::IOException, "\"" + path + "\" has unsupported state database version " + std::to_string(header.version));
+		}
+		const uint64_t body = file->size() - sizeof(header);
+		if (header.count > body / sizeof(StateRecord) || body - header.count * sizeof(StateRecord) != header.poolLength) {
+			lnthrow(fs::IOException, "\"" + path + "\" is truncated or corrupt");
+		}
+
+		records = reinterpret_cast<const StateRecord*>(file->data() + sizeof(header));
+		pool = reinterpret_cast<const char*>(records + header.count);
+		// Bounds are checked once here so that lookups cannot read outside of the mapping.
+		for (uint64_t i = 0; i < header.count; ++i) {
+			const StateRecord& r = records[i];
+			if (r.pathOffset > header.poolLength || header.poolLength - r.pathOffset < r.pathLength ||
+				r.hashOffset > header.poolLength || header.poolLength - r.hashOffset < r.hashLength) {
+				records = nullptr;
+				pool = nullptr;
+				lnthrow(fs::IOException, "\"" + path + "\" has a corrupt record at index " + std::to_string(i));
+			}
+		}
+		count = header.count;
+	}
+
+	/**
+	 * @brief Calls a function on every path and state in the merged database in order. The mutex must be held.
+	 * The function takes the path, the record from the file or nullptr, and the pending state or nullptr; exactly one of the two is non-null.
+	 */
+	template <typename F>
+	void forEachMerged(F func) const {
+		uint64_t i = 0;
+		auto it = pending.begin();
+
+		while (i < count || it != pending.end()) {
+			std::string_view recPath = i < count ? recordPath(records[i]) : std::string_view();
+			if (it == pending.end() || (i < count && recPath < it->first)) {
+				func(recPath, &records[i], nullptr);
+				++i;
+				continue;
+			}
+			if (i < count && recPath == it->first) {
+				// The pending change supersedes the record.
+				++i;
+			}
+			if (it->second) {
+				func(std::string_view(it->first), nullptr, &it->second.value());
+			}
+			++it;
+		}
+	}
+};
+
+StateDatabase::StateDatabase(const char* path): impl(std::make_unique<StateDatabaseImpl>()) {
+	this->impl->path = path;
+	this->impl->open();
+}
+
+StateDatabase::StateDatabase(StateDatabase&& other) noexcept = default;
+
+StateDatabase& StateDatabase::operator=(StateDatabase&& other) noexcept = default;
+
+StateDatabase::~StateDatabase() = default;
+
+std::optional<FileState> StateDatabase::get(const char* path) const {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	return this->impl->lookup(path);
+}
+
+std::optional<FileState> StateDatabase::getUnchanged(const char* path, const struct stat& st) const {
+	std::optional<FileState> ret = this->get(path);
+
+	if (!ret || !ret->matches(st)) {
+		return std::nullopt;
+	}
+	return ret;
+}
+
+void StateDatabase::put(const char* path, const FileState& state) {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->pending.insert_or_assign(path, state);
+}
+
+bool StateDatabase::remove(const char* path) {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	bool ret = this->impl->lookup(path).has_value();
+
+	if (ret) {
+		this->impl->pending.insert_or_assign(path, std::nullopt);
+	}
+	return ret;
+}
+
+uint64_t StateDatabase::size() const {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	uint64_t ret = this->impl->count;
+
+	for (const auto& change : this->impl->pending) {
+		bool inFile = this->impl->findRecord(change.first) != nullptr;
+		if (change.second && !inFile) {
+			ret++;
+		}
+		else if (!change.second && inFile) {
+			ret--;
+		}
+	}
+	return ret;
+}
+
+void StateDatabase::flush() {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	StateDatabaseImpl& s = *this->impl;
+	std::string tmpPath = s.path + ".tmp";
+	StateHeader header = {};
+
+	if (s.pending.empty()) {
+		return;
+	}
+
+	std::memcpy(header.magic, STATEDB_MAGIC, sizeof(STATEDB_MAGIC));
+	header.version = STATEDB_VERSION;
+	header.byteOrder = STATEDB_BYTE_ORDER;
+	s.forEachMerged([&](std::string_view path, const StateRecord* rec, const FileState* state) {
+		header.count++;
+		header.poolLength += path.size() + (rec ? rec->hashLength : state->hash.size());
+	});
+
+	{
+		std::ofstream ofs(tmpPath, std::ios_base::binary | std::ios_base::trunc);
+		uint64_t poolPos = 0;
+
+		ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		s.forEachMerged([&](std::string_view path, const StateRecord* rec, const FileState* state) {
+			StateRecord out;
+			out.pathOffset = poolPos;
+			out.pathLength = path.size();
+			out.hashOffset = poolPos + path.size();
+			out.hashLength = rec ? rec->hashLength : state->hash.size();
+			out.inode = rec ? rec->inode : state->inode;
+			out.size = rec ? rec->size : state->size;
+			out.mtimeNs = rec ? rec->mtimeNs : state->mtimeNs;
+			out.ctimeNs = rec ? rec->ctimeNs : state->ctimeNs;
+			poolPos += out.pathLength + out.hashLength;
+			ofs.write(reinterpret_cast<const char*>(&out), sizeof(out));
+		});
+		s.forEachMerged([&](std::string_view path, const StateRecord* rec, const FileState* state) {
+			ofs.write(path.data(), path.size());
+			if (rec) {
+				ofs.write(s.pool + rec->hashOffset, rec->hashLength);
+			}
+			else {
+				ofs.write(state->hash.data(), state->hash.size());
+			}
+		});
+
+		ofs.close();
+		if (!ofs) {
+			std::remove(tmpPath.c_str());
+			lnthrow(fs::IOException, "Failed to write state database \"" + tmpPath + "\"");
+		}
+	}
+
+	// Without the syncs, a crash soon after the rename can leave the new name pointing at a file whose data never reached the disk.
+	try {
+		fs::sync(tmpPath.c_str());
+		std::filesystem::rename(tmpPath, s.path);
+	}
+	catch (std::exception& e) {
+		std::remove(tmpPath.c_str());
+		lnthrow(fs::IOException, "Failed to replace state database \"" + s.path + "\"", e);
+	}
+	std::string dir = fs::parentDir(s.path.c_str());
+	fs::sync(dir.empty() ? "." : dir.c_str());
+
+	LOG(LEVEL_DEBUG) << "Flushed " << s.pending.size() << " changes to \"" << s.path << "\", which now has " << header.count << " files";
+	s.pending.clear();
+	s.open();
+}
+
+}
@@ -0,0 +1,126 @@
+/** @file statedb.hpp
+ * @brief Remembers the state of every synced file, so unchanged files can be skipped without reading them.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#ifndef __CS_STATEDB_HPP
+#define __CS_STATEDB_HPP
+
+#include <sys/stat.h>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace CloudSync{
+
+/**
+ * @brief The state of a local file as of the last time it was synced.
+ */
+struct FileState {
+	uint64_t inode = 0;
+	uint64_t size = 0;
+	int64_t mtimeNs = 0;
+	int64_t ctimeNs = 0;
+	/**
+	 * @brief A hash of the file's contents. Its format is up to the caller.
+	 */
+	std::string hash;
+
+	/**
+	 * @brief Makes a FileState out of the attributes of a file.
+	 *
+	 * @param st The attributes of the file, as filled in by stat().
+	 * @param hash The hash of the file's contents.
+	 */
+	static FileState fromStat(const struct stat& st, std::string hash);
+
+	/**
+	 * @brief Returns true if a file with these attributes is the same as it was when this state was recorded.
+	 * The ctime is included because it changes even when a tool restores the mtime after modifying a file.
+	 */
+	bool matches(const struct stat& st) const;
+};
+
+/**
+ * @brief A file of FileStates keyed by path.
+ *
+ * The file holds fixed-size records sorted by path, followed by a string pool, and is memory-mapped when opened.
+ * A lookup is a binary search that only touches the pages it needs, so opening a database of millions of files costs nothing up front.
+ * Changes are kept in memory until flush(), which merges them with the file in a single pass and replaces it.
+ * Records are in native byte order.
+ *
+ * This class is thread-safe.
+ */
+class StateDatabase {
+public:
+	/**
+	 * @brief Opens a state database, or starts an empty one if the file does not exist yet.
+	 *
+	 * @param path The path of the database.
+	 *
+	 * @exception fs::IOException The file could not be read or is not a state database.
+	 */
+	StateDatabase(const char* path);
+
+	StateDatabase(StateDatabase&& other) noexcept;
+	StateDatabase& operator=(StateDatabase&& other) noexcept;
+	~StateDatabase();
+
+	/**
+	 * @brief Gets the recorded state of a file.
+	 *
+	 * @return The state, or std::nullopt if the file is not in the database.
+	 */
+	std::optional<FileState> get(const char* path) const;
+
+	/**
+	 * @brief Gets the recorded state of a file if the file has not changed since.
+	 * If this returns a state, its hash can be used as is instead of reading the file again.
+	 *
+	 * @param path The file to look up.
+	 * @param st The current attributes of the file.
+	 *
+	 * @return The state, or std::nullopt if the file is not in the database or has changed.
+	 */
+	std::optional<FileState> getUnchanged(const char* path, const struct stat& st) const;
+
+	/**
+	 * @brief Records the state of a file, replacing its old state if there is one.
+	 * The change is not written to disk until flush() is called.
+	 */
+	void put(const char* path, const FileState& state);
+
+	/**
+	 * @brief Removes a file from the database.
+	 * The change is not written to disk until flush() is called.
+	 *
+	 * @return True if the file was in the database, false if not.
+	 */
+	bool remove(const char* path);
+
+	/**
+	 * @brief Returns the number of files in the database, including unflushed changes.
+	 * This has to look up every pending change, so avoid it in a loop.
+	 */
+	uint64_t size() const;
+
+	/**
+	 * @brief Writes pending changes to disk.
+	 * The new file is synced to disk before it atomically replaces the old one, so a crash leaves either the old or the new database.
+	 *
+	 * @exception fs::IOException There was an I/O error writing the database.
+	 */
+	void flush();
+
+private:
+	struct StateDatabaseImpl;
+	std::unique_ptr<StateDatabaseImpl> impl;
+};
+
+}
+
+#endif
@@ -0,0 +1,86 @@
+/** @file adaptivetimeout_test.cpp
+ * @brief tests adaptivetimeout
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "../adaptivetimeout.hpp"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST(AdaptiveTimeoutTest, InitialTimeout) {
+	CloudSync::AdaptiveTimeout at(5000);
+	EXPECT_EQ(at.getTimeoutMs(), 5000);
+	at.record(100ms);
+	// Too few samples to use the window yet.
+	EXPECT_EQ(at.getTimeoutMs(), 5000);
+}
+
+TEST(AdaptiveTimeoutTest, FollowsLatency) {
+	CloudSync::AdaptiveTimeout at(10000, 100, 60000);
+	at.setPolicy(1.0, 2.0, 0, 4);
+	for (int i = 0; i < 4; ++i) {
+		at.record(1000ms);
+	}
+	EXPECT_EQ(at.getTimeoutMs(), 2000);
+	for (int i = 0; i < 4; ++i) {
+		at.record(3000ms);
+	}
+	EXPECT_EQ(at.getTimeoutMs(), 6000);
+}
+
+TEST(AdaptiveTimeoutTest, Clamped) {
+	CloudSync::AdaptiveTimeout at(10000, 1000, 4000);
+	at.setPolicy(0.95, 2.0, 500, 1);
+	at.record(1ms);
+	EXPECT_EQ(at.getTimeoutMs(), 1000);
+	at.record(60s);
+	EXPECT_EQ(at.getTimeoutMs(), 4000);
+	EXPECT_THROW(CloudSync::AdaptiveTimeout(1000, 2000, 1000), std::invalid_argument);
+}
+
+TEST(AdaptiveTimeoutTest, Latencies) {
+	CloudSync::AdaptiveTimeout at(10000, 100, 60000, 3);
+	at.setPolicy(1.0, 2.0, 0, 3);
+	EXPECT_TRUE(at.getLatencies().empty());
+	for (auto latency : { 100ms, 200ms, 300ms, 400ms }) {
+		at.record(latency);
+	}
+	// The oldest latency has fallen out of the window.
+	EXPECT_EQ(at.getLatencies(), std::vector<std::chrono::milliseconds>({ 200ms, 300ms, 400ms }));
+
+	CloudSync::AdaptiveTimeout next(10000, 100, 60000, 3);
+	next.setPolicy(1.0, 2.0, 0, 3);
+	for (auto latency : at.getLatencies()) {
+		next.record(latency);
+	}
+	EXPECT_EQ(next.getTimeoutMs(), at.getTimeoutMs());
+	EXPECT_EQ(next.getTimeoutMs(), 800);
+}
+
+TEST(AdaptiveTimeoutTest, RetryDelay) {
+	CloudSync::RetryPolicy rp;
+	rp.baseDelayMs = 100;
+	rp.maxDelayMs = 1000;
+	for (int i = 0; i < 10; ++i) {
+		const auto delay = rp.delay(i);
+		EXPECT_LE(delay.count(), 1000);
+		EXPECT_GE(delay.count(), 75);
+	}
+	EXPECT_LE(rp.delay(0).count(), 100);
+}
+
+#ifndef __MAIN_TEST__
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
+
+#endif
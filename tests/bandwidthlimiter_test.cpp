@@ -0,0 +1,94 @@
+/** @file bandwidthlimiter_test.cpp
+ * @brief tests bandwidthlimiter
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "../bandwidthlimiter.hpp"
+#include <chrono>
+#include <ctime>
+#include <gtest/gtest.h>
+
+/**
+ * @brief Makes a local time on the given day of January 2018, which started on a Monday.
+ */
+static std::time_t makeTime(int day, int hour) {
+	struct tm t = {};
+	t.tm_year = 118;
+	t.tm_mon = 0;
+	t.tm_mday = day;
+	t.tm_hour = hour;
+	t.tm_isdst = -1;
+	return std::mktime(&t);
+}
+
+TEST(BandwidthLimiterTest, Schedule) {
+	CloudSync::BandwidthSchedule schedule;
+	schedule.businessHours.uploadBytesPerSecond = 1000;
+	schedule.offHours.uploadBytesPerSecond = 0;
+
+	EXPECT_EQ(schedule.limitsAt(makeTime(1, 9)).uploadBytesPerSecond, 1000u);
+	EXPECT_EQ(schedule.limitsAt(makeTime(1, 16)).uploadBytesPerSecond, 1000u);
+	EXPECT_EQ(schedule.limitsAt(makeTime(1, 17)).uploadBytesPerSecond, 0u);
+	EXPECT_EQ(schedule.limitsAt(makeTime(1, 3)).uploadBytesPerSecond, 0u);
+	// Saturday
+	EXPECT_EQ(schedule.limitsAt(makeTime(6, 12)).uploadBytesPerSecond, 0u);
+
+	schedule.weekendsOff = false;
+	schedule.businessStartHour = 22;
+	schedule.businessEndHour = 6;
+	EXPECT_EQ(schedule.limitsAt(makeTime(6, 23)).uploadBytesPerSecond, 1000u);
+	EXPECT_EQ(schedule.limitsAt(makeTime(6, 2)).uploadBytesPerSecond, 1000u);
+	EXPECT_EQ(schedule.limitsAt(makeTime(6, 12)).uploadBytesPerSecond, 0u);
+}
+
+TEST(BandwidthLimiterTest, TokenBucketRate) {
+	CloudSync::TokenBucket tb(1000000, 100000);
+	auto start = std::chrono::steady_clock::now();
+
+	// The first 100KB are the burst, the other 200KB take 0.2s at 1MB/s.
+	for (int i = 0; i < 30; ++i) {
+		tb.acquire(10000);
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	EXPECT_GE(elapsed, std::chrono::milliseconds(180));
+	EXPECT_LE(elapsed, std::chrono::milliseconds(400));
+}
+
+TEST(BandwidthLimiterTest, TryAcquire) {
+	CloudSync::TokenBucket tb(1000, 1000);
+	EXPECT_TRUE(tb.tryAcquire(600));
+	EXPECT_FALSE(tb.tryAcquire(600));
+
+	tb.setRate(0);
+	EXPECT_TRUE(tb.tryAcquire(1000000));
+}
+
+TEST(BandwidthLimiterTest, Limiter) {
+	CloudSync::BandwidthSchedule schedule;
+	schedule.businessHours.downloadBytesPerSecond = 1000000;
+	schedule.offHours.downloadBytesPerSecond = 1000000;
+	CloudSync::BandwidthLimiter bl(schedule);
+
+	EXPECT_EQ(bl.getCurrentLimits().downloadBytesPerSecond, 1000000u);
+	EXPECT_EQ(bl.getCurrentLimits().uploadBytesPerSecond, 0u);
+
+	auto start = std::chrono::steady_clock::now();
+	// Uploads are unlimited.
+	bl.acquire(CloudSync::TransferType::Upload, 100000000);
+	EXPECT_LE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+	bl.acquire(CloudSync::TransferType::Download, 1000000);
+	bl.acquire(CloudSync::TransferType::Download, 100000);
+	EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(80));
+}
+
+#ifndef __MAIN_TEST__
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
+
+#endif
@@ -0,0 +1,300 @@
+/** @file tests/localdirclient_test.cpp
+ * @brief Tests LocalDirClient.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "../localdirclient.hpp"
+#include "test_ext.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <gtest/gtest.h>
+
+constexpr const char* cloudDir = "cloudDir";
+constexpr const char* localDir = "localDir";
+
+class LocalDirClientTest : public testing::Test {
+protected:
+	LocalDirClientTest(): client(cloudDir) {}
+
+	virtual ~LocalDirClientTest() {}
+
+	virtual void SetUp() override {
+		ASSERT_TRUE(client.login("", ""));
+	}
+
+	virtual void TearDown() override {
+		std::filesystem::remove_all(cloudDir);
+	}
+
+	CloudSync::LocalDirClient client;
+};
+
+TEST_F(LocalDirClientTest, MkdirTest) {
+	EXPECT_TRUE(client.mkdir("/dir1"));
+	EXPECT_TRUE(client.mkdir("/dir1/dir2"));
+	EXPECT_TRUE(TestExt::dirExists("cloudDir/dir1/dir2"));
+
+	EXPECT_FALSE(client.mkdir("/dir1"));
+	EXPECT_FALSE(client.mkdir("/noexist/dir3"));
+	EXPECT_FALSE(client.mkdir("/../escape"));
+	EXPECT_TRUE(client.getLastError() != nullptr);
+}
+
+TEST_F(LocalDirClientTest, UploadDownloadTest) {
+	TestExt::TestEnvironment te = TestExt::TestEnvironment::Basic(localDir, 3);
+	struct stat st;
+
+	ASSERT_TRUE(client.mkdir("/up"));
+	EXPECT_TRUE(client.upload("localDir/test0.txt", "/up"));
+	EXPECT_TRUE(client.upload("localDir/test1.txt", "/up/renamed.txt"));
+	EXPECT_FALSE(client.upload("localDir/test2.txt", "/up/renamed.txt"));
+	EXPECT_FALSE(client.upload("localDir/test2.txt", "/noexist/test2.txt"));
+
+	ASSERT_TRUE(client.stat("/up/renamed.txt", &st));
+	EXPECT_TRUE(S_ISREG(st.st_mode));
+
+	std::vector<std::string> names = client.readdir("/up").value();
+	std::sort(names.begin(), names.end());
+	EXPECT_TRUE(names == std::vector<std::string>({ "renamed.txt", "test0.txt" }));
+
+	EXPECT_TRUE(client.download("/up/renamed.txt", "localDir/down.txt"));
+	EXPECT_TRUE(TestExt::compare("localDir/test1.txt", "localDir/down.txt") == 0);
+	EXPECT_FALSE(client.download("/up", "localDir/down2.txt"));
+}
+
+TEST_F(LocalDirClientTest, MoveRemoveTest) {
+	TestExt::TestEnvironment te = TestExt::TestEnvironment::Basic(localDir, 1);
+
+	ASSERT_TRUE(client.mkdir("/a"));
+	ASSERT_TRUE(client.mkdir("/b"));
+	ASSERT_TRUE(client.upload("localDir/test0.txt", "/a/file.txt"));
+
+	EXPECT_TRUE(client.move("/a/file.txt", "/b"));
+	EXPECT_TRUE(client.stat("/b/file.txt", nullptr));
+	EXPECT_TRUE(client.move("/b/file.txt", "/a/moved.txt"));
+	EXPECT_FALSE(client.stat("/b/file.txt", nullptr));
+
+	EXPECT_FALSE(client.remove("/a"));
+	EXPECT_TRUE(client.remove("/a/moved.txt"));
+	EXPECT_TRUE(client.remove("/a"));
+	EXPECT_FALSE(client.remove("/a"));
+}
+
+TEST_F(LocalDirClientTest, CopyTest) {
+	TestExt::TestEnvironment te = TestExt::TestEnvironment::Basic(localDir, 1);
+
+	ASSERT_TRUE(client.mkdir("/a"));
+	ASSERT_TRUE(client.mkdir("/a/sub"));
+	ASSERT_TRUE(client.mkdir("/b"));
+	ASSERT_TRUE(client.upload("localDir/test0.txt", "/a/sub/file.txt"));
+
+	EXPECT_TRUE(client.copy("/a", "/b"));
+	EXPECT_TRUE(client.stat("/b/a/sub/file.txt", nullptr));
+	EXPECT_TRUE(client.copy("/a/sub/file.txt", "/b/copy.txt"));
+	EXPECT_TRUE(TestExt::compare("cloudDir/b/copy.txt", "localDir/test0.txt") == 0);
+	EXPECT_TRUE(client.stat("/a/sub/file.txt", nullptr));
+
+	EXPECT_FALSE(client.copy("/a/sub/file.txt", "/b/copy.txt"));
+	EXPECT_FALSE(client.copy("/a", "/b"));
+	EXPECT_FALSE(client.copy("/noexist", "/b/x"));
+}
+
+/**
+ * @brief Forwards to another client, but leaves copy() to the default implementation.
+ */
+class DefaultCopyClient : public CloudSync::BaseClient {
+public:
+	DefaultCopyClient(CloudSync::BaseClient& client): client(client) {}
+
+	bool login(const char* username, const char* password) override { return client.login(username, password); }
+	bool mkdir(const char* dir) override { return client.mkdir(dir); }
+	std::optional<std::vector<std::string>> readdir(const char* dir) override { return client.readdir(dir); }
+	bool stat(const char* path, struct stat* st) override { return client.stat(path, st); }
+	bool move(const char* oldPath, const char* newPath) override { return client.move(oldPath, newPath); }
+	bool download(const char* cloudPath, const char* diskPath) override { return client.download(cloudPath, diskPath); }
+	bool upload(const char* diskPath, const char* cloudPath) override { return client.upload(diskPath, cloudPath); }
+	bool remove(const char* path) override { return client.remove(path); }
+	bool logout() override { return client.logout(); }
+
+private:
+	CloudSync::BaseClient& client;
+};
+
+TEST_F(LocalDirClientTest, CopyIntoItselfTest) {
+	TestExt::TestEnvironment te = TestExt::TestEnvironment::Basic(localDir, 1);
+	DefaultCopyClient emulated(client);
+
+	ASSERT_TRUE(client.mkdir("/a"));
+	ASSERT_TRUE(client.mkdir("/a/b"));
+	ASSERT_TRUE(client.upload("localDir/test0.txt", "/a/b/file.txt"));
+
+	for (CloudSync::BaseClient* c : { static_cast<CloudSync::BaseClient*>(&client), static_cast<CloudSync::BaseClient*>(&emulated) }) {
+		EXPECT_FALSE(c->copy("/a", "/a"));
+		EXPECT_FALSE(c->copy("/a", "/a/b"));
+		EXPECT_FALSE(c->copy("/a/", "//a/b/"));
+		EXPECT_FALSE(client.stat("/a/a", nullptr));
+		EXPECT_FALSE(client.stat("/a/b/a", nullptr));
+	}
+
+	// A sibling that only shares a prefix is not inside of the source.
+	ASSERT_TRUE(client.mkdir("/ab"));
+	EXPECT_TRUE(emulated.copy("/a", "/ab"));
+	EXPECT_TRUE(TestExt::compare("cloudDir/ab/a/b/file.txt", "localDir/test0.txt") == 0);
+	EXPECT_TRUE(emulated.copy("/a/b/file.txt", "/a/copy.txt"));
+	EXPECT_TRUE(client.stat("/a/copy.txt", nullptr));
+}
+
+TEST_F(LocalDirClientTest, BatchTest) {
+	// Children come before their parents to check that the batch is reordered.
+	std::vector<bool> res = client.mkdirAll({ "/a/b/c", "/a", "/a/b", "/x/y", "/d" });
+	EXPECT_EQ(res, std::vector<bool>({ true, true, true, false, true }));
+	EXPECT_TRUE(TestExt::dirExists("cloudDir/a/b/c"));
+	// Existing directories count as created.
+	EXPECT_EQ(client.mkdirAll({ "/a", "/a/e" }), std::vector<bool>({ true, true }));
+
+	res = client.moveMany({ { "/a/b", "/d" }, { "/a/b/c", "/a/c2" }, { "/noexist", "/d" } });
+	EXPECT_EQ(res, std::vector<bool>({ true, true, false }));
+	EXPECT_TRUE(TestExt::dirExists("cloudDir/a/c2"));
+	EXPECT_TRUE(TestExt::dirExists("cloudDir/d/b"));
+
+	res = client.removeMany({ "/a", "/a/c2", "/a/e" });
+	EXPECT_EQ(res, std::vector<bool>({ true, true, true }));
+	EXPECT_FALSE(client.stat("/a", nullptr));
+}
+
+TEST_F(LocalDirClientTest, RemoveRecursiveTest) {
+	TestExt::TestEnvironment te = TestExt::TestEnvironment::Basic(localDir, 1);
+	uint64_t removed = 0;
+	uint64_t total = 0;
+
+	ASSERT_EQ(client.mkdirAll({ "/a", "/a/b", "/a/b/c", "/a/d" }), std::vector<bool>({ true, true, true, true }));
+	ASSERT_TRUE(client.upload("localDir/test0.txt", "/a/b/c/file.txt"));
+	ASSERT_TRUE(client.upload("localDir/test0.txt", "/a/file.txt"));
+
+	EXPECT_TRUE(client.removeRecursive("/a", [&](uint64_t r, uint64_t t) {
+		removed = r;
+		total = t;
+	}));
+	EXPECT_FALSE(client.stat("/a", nullptr));
+	EXPECT_GT(total, 0u);
+	EXPECT_EQ(removed, total);
+
+	EXPECT_FALSE(client.removeRecursive("/noexist"));
+	EXPECT_FALSE(client.removeRecursive("/"));
+	EXPECT_TRUE(TestExt::dirExists(cloudDir));
+}
+
+TEST_F(LocalDirClientTest, ReaddirPlusTest) {
+	TestExt::TestEnvironment te = TestExt::TestEnvironment::Basic(localDir, 1);
+
+	ASSERT_TRUE(client.mkdir("/dir"));
+	ASSERT_TRUE(client.mkdir("/dir/sub"));
+	ASSERT_TRUE(client.upload("localDir/test0.txt", "/dir/file.txt"));
+
+	std::vector<CloudSync::DirEntry> entries = client.readdirPlus("/dir").value();
+	std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+		return a.name < b.name;
+	});
+	ASSERT_TRUE(entries.size() == 2);
+	EXPECT_TRUE(entries[0].name == "file.txt");
+	EXPECT_TRUE(S_ISREG(entries[0].st.st_mode));
+	EXPECT_TRUE(static_cast<uint64_t>(entries[0].st.st_size) == std::filesystem::file_size("localDir/test0.txt"));
+	EXPECT_TRUE(entries[1].name == "sub");
+	EXPECT_TRUE(S_ISDIR(entries[1].st.st_mode));
+
+	EXPECT_FALSE(client.readdirPlus("/noexist").has_value());
+}
+
+TEST_F(LocalDirClientTest, ReaddirVisitTest) {
+	std::vector<std::string> names;
+	int visited = 0;
+
+	ASSERT_TRUE(client.mkdir("/dir"));
+	ASSERT_TRUE(client.mkdir("/dir/a"));
+	ASSERT_TRUE(client.mkdir("/dir/b"));
+
+	EXPECT_TRUE(client.readdirVisit("/dir", [&names](std::string_view name) {
+		names.emplace_back(name);
+		return true;
+	}));
+	std::sort(names.begin(), names.end());
+	EXPECT_TRUE(names == std::vector<std::string>({ "a", "b" }));
+
+	EXPECT_TRUE(client.readdirVisit("/dir", [&visited](std::string_view) {
+		visited++;
+		return false;
+	}));
+	EXPECT_TRUE(visited == 1);
+
+	EXPECT_FALSE(client.readdirVisit("/noexist", [](std::string_view) { return true; }));
+}
+
+TEST_F(LocalDirClientTest, UploadStreamTest) {
+	std::vector<unsigned char> data(200000);
+	size_t pos = 0;
+	TestExt::fillData(data.data(), data.size());
+
+	auto source = [&data, &pos](unsigned char* buf, size_t len) {
+		size_t n = std::min(len, data.size() - pos);
+		std::memcpy(buf, data.data() + pos, n);
+		pos += n;
+		return n;
+	};
+
+	EXPECT_TRUE(client.uploadStream(source, "/stream.bin"));
+	EXPECT_TRUE(TestExt::compare("cloudDir/stream.bin", data) == 0);
+	EXPECT_FALSE(client.uploadStream(source, "/stream.bin"));
+	EXPECT_FALSE(client.uploadStream([](unsigned char*, size_t) -> size_t {
+		throw std::runtime_error("source failed");
+	}, "/failed.bin"));
+	EXPECT_FALSE(client.stat("/failed.bin", nullptr));
+	EXPECT_TRUE(client.readdir("/").value().size() == 1);
+}
+
+TEST_F(LocalDirClientTest, DownloadStreamTest) {
+	TestExt::TestEnvironment te = TestExt::TestEnvironment::Basic(localDir, 1, 300000);
+	std::vector<unsigned char> received;
+
+	ASSERT_TRUE(client.upload("localDir/test0.txt", "/file.txt"));
+	EXPECT_TRUE(client.downloadStream("/file.txt", [&received](const unsigned char* buf, size_t len) {
+		received.insert(received.end(), buf, buf + len);
+		return true;
+	}));
+	EXPECT_TRUE(TestExt::compare("localDir/test0.txt", received) == 0);
+
+	EXPECT_FALSE(client.downloadStream("/noexist.txt", [](const unsigned char*, size_t) { return true; }));
+}
+
+TEST_F(LocalDirClientTest, TransferObserverTest) {
+	TestExt::TestEnvironment te = TestExt::TestEnvironment::Basic(localDir, 1, 300000);
+	const uint64_t size = std::filesystem::file_size("localDir/test0.txt");
+	uint64_t bytes = 0;
+	CloudSync::BaseClient::TransferObserver observer;
+
+	observer.onProgress = [&bytes](uint64_t n) {
+		bytes += n;
+	};
+	uint64_t token = client.addTransferObserver(observer);
+
+	ASSERT_TRUE(client.upload("localDir/test0.txt", "/file.txt"));
+	EXPECT_EQ(bytes, size);
+	ASSERT_TRUE(client.downloadStream("/file.txt", [](const unsigned char*, size_t) { return true; }));
+	EXPECT_EQ(bytes, 2 * size);
+
+	client.removeTransferObserver(token);
+	ASSERT_TRUE(client.download("/file.txt", "localDir/down.txt"));
+	EXPECT_EQ(bytes, 2 * size);
+}
+
+#ifndef __MAIN_TEST__
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
+
+#endif
@@ -0,0 +1,169 @@
+/** @file tests/netsimclient_test.cpp
+ * @brief Tests NetSimClient.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "../localdirclient.hpp"
+#include "../netsimclient.hpp"
+#include "test_ext.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+constexpr const char* cloudDir = "cloudDir";
+constexpr const char* localDir = "localDir";
+
+class NetSimClientTest : public testing::Test {
+protected:
+	NetSimClientTest(): local(cloudDir) {}
+
+	virtual ~NetSimClientTest() {}
+
+	virtual void SetUp() override {
+		ASSERT_TRUE(local.login("", ""));
+	}
+
+	virtual void TearDown() override {
+		std::filesystem::remove_all(cloudDir);
+	}
+
+	/**
+	 * @brief Returns how long a function took to run in milliseconds.
+	 */
+	template <typename F>
+	static long long timeMs(F func) {
+		auto start = std::chrono::steady_clock::now();
+		func();
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	CloudSync::LocalDirClient local;
+};
+
+TEST_F(NetSimClientTest, LatencyTest) {
+	CloudSync::NetSimConfig config;
+	config.latencyMs = 30;
+	config.jitterMs = 10;
+	config.seed = 1;
+	CloudSync::NetSimClient client(local, config);
+
+	EXPECT_GE(timeMs([&] { EXPECT_TRUE(client.mkdir("/dir")); }), 20);
+	EXPECT_GE(timeMs([&] { EXPECT_TRUE(client.stat("/dir", nullptr)); }), 20);
+	EXPECT_GE(timeMs([&] { EXPECT_FALSE(client.stat("/noexist", nullptr)); }), 20);
+
+	config.latencyMs = 0;
+	config.jitterMs = 0;
+	client.setConfig(config);
+	EXPECT_LT(timeMs([&] { EXPECT_TRUE(client.readdir("/dir").has_value()); }), 20);
+}
+
+TEST_F(NetSimClientTest, BandwidthTest) {
+	std::filesystem::create_directory(localDir);
+	std::ofstream(std::string(localDir) + "/file.bin") << std::string(100000, 'x');
+	CloudSync::NetSimConfig config;
+	// 100 KB at 500 KB/s takes 200 ms.
+	config.bytesPerSecond = 500000;
+	CloudSync::NetSimClient client(local, config);
+
+	EXPECT_GE(timeMs([&] { EXPECT_TRUE(client.upload("localDir/file.bin", "/file.bin")); }), 190);
+
+	// The downloaded file must not appear before the link could have carried all of it.
+	std::thread downloader([&] {
+		EXPECT_TRUE(client.download("/file.bin", "localDir/down.bin"));
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	EXPECT_FALSE(std::filesystem::exists("localDir/down.bin"));
+	downloader.join();
+	EXPECT_TRUE(TestExt::compare("localDir/file.bin", "localDir/down.bin") == 0);
+
+	// Concurrent transfers share the link.
+	long long ms = timeMs([&] {
+		std::thread other([&] {
+			EXPECT_TRUE(client.download("/file.bin", "localDir/down2.bin"));
+		});
+		EXPECT_TRUE(client.download("/file.bin", "localDir/down3.bin"));
+		other.join();
+	});
+	EXPECT_GE(ms, 390);
+
+	EXPECT_FALSE(client.download("/noexist", "localDir/noexist.bin"));
+	EXPECT_FALSE(client.download("/file.bin", "localDir/down.bin"));
+	// Neither a finished nor a failed download leaves its temporary file behind.
+	for (const auto& entry : std::filesystem::directory_iterator(localDir)) {
+		EXPECT_NE(entry.path().filename().string().rfind("tmp_", 0), 0u);
+	}
+	std::filesystem::remove_all(localDir);
+}
+
+TEST_F(NetSimClientTest, FailureTest) {
+	CloudSync::NetSimConfig config;
+	config.failureRate = 1;
+	CloudSync::NetSimClient client(local, config);
+	int succeeded = 0;
+
+	// A failed request never reaches the wrapped client.
+	EXPECT_FALSE(client.mkdir("/dir"));
+	EXPECT_FALSE(local.stat("/dir", nullptr));
+	EXPECT_EQ(client.mkdirAll({ "/a", "/a/b" }), std::vector<bool>({ false, false }));
+	EXPECT_FALSE(local.stat("/a", nullptr));
+
+	config.failureRate = 0.5;
+	config.seed = 42;
+	client.setConfig(config);
+	for (int i = 0; i < 100; ++i) {
+		succeeded += client.mkdir(("/d" + std::to_string(i)).c_str());
+	}
+	EXPECT_GT(succeeded, 20);
+	EXPECT_LT(succeeded, 80);
+	EXPECT_EQ(local.readdir("/").value().size(), static_cast<size_t>(succeeded));
+}
+
+TEST_F(NetSimClientTest, RemoveRecursiveTest) {
+	TestExt::TestEnvironment te = TestExt::TestEnvironment::Basic(localDir, 1);
+	CloudSync::NetSimConfig config;
+	uint64_t removed = 0;
+	uint64_t total = 0;
+	bool monotonic = true;
+
+	ASSERT_EQ(local.mkdirAll({ "/a", "/a/b", "/a/b/c", "/a/d" }), std::vector<bool>({ true, true, true, true }));
+	ASSERT_TRUE(local.upload("localDir/test0.txt", "/a/b/c/file.txt"));
+	ASSERT_TRUE(local.upload("localDir/test0.txt", "/a/file.txt"));
+
+	// Every request fails, so nothing may be removed.
+	config.failureRate = 1;
+	CloudSync::NetSimClient client(local, config);
+	EXPECT_FALSE(client.removeRecursive("/a"));
+	EXPECT_TRUE(local.stat("/a/b/c/file.txt", nullptr));
+
+	// The default implementation lists and removes every entry through the simulated link, so a three-level tree costs several round trips.
+	config.failureRate = 0;
+	config.latencyMs = 20;
+	client.setConfig(config);
+	long long ms = timeMs([&] {
+		EXPECT_TRUE(client.removeRecursive("/a", [&](uint64_t r, uint64_t t) {
+			monotonic = monotonic && r > removed;
+			removed = r;
+			total = t;
+		}));
+	});
+	EXPECT_FALSE(local.stat("/a", nullptr));
+	EXPECT_TRUE(monotonic);
+	EXPECT_EQ(total, 6u);
+	EXPECT_EQ(removed, total);
+	EXPECT_GE(ms, 6 * 20);
+}
+
+#ifndef __MAIN_TEST__
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
+
+#endif
@@ -0,0 +1,123 @@
+/** @file tests/remoteindex_test.cpp
+ * @brief Tests RemoteIndex.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "../remoteindex.hpp"
+#include "../localdirclient.hpp"
+#include "../fs/ioexception.hpp"
+#include "../fs/notfoundexception.hpp"
+#include "test_ext.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+
+constexpr const char* cloudDir = "cloudDir";
+constexpr const char* localDir = "localDir";
+constexpr const char* indexFname = "remote.idx";
+
+class RemoteIndexTest : public testing::Test {
+protected:
+	RemoteIndexTest(): client(cloudDir) {}
+
+	virtual void SetUp() override {
+		ASSERT_TRUE(client.login("", ""));
+		ASSERT_EQ(client.mkdirAll({ "/b", "/b/d", "/a" }), std::vector<bool>({ true, true, true }));
+		ASSERT_TRUE(client.upload("localDir/test0.txt", "/b/d/file.txt"));
+		ASSERT_TRUE(client.upload("localDir/test1.txt", "/c.txt"));
+	}
+
+	virtual void TearDown() override {
+		std::filesystem::remove_all(cloudDir);
+		std::remove(indexFname);
+	}
+
+	TestExt::TestEnvironment te = TestExt::TestEnvironment::Basic(localDir, 2);
+	CloudSync::LocalDirClient client;
+};
+
+/**
+ * @brief Checks the snapshot of the tree made in SetUp().
+ */
+static void checkIndex(const CloudSync::RemoteIndex& index) {
+	using CloudSync::RemoteIndex;
+
+	ASSERT_EQ(index.count(), 6u);
+	EXPECT_EQ(index.parent(0), RemoteIndex::NONE);
+	EXPECT_EQ(index.path(0), "/");
+
+	// The root's children come first, sorted by name.
+	EXPECT_EQ(index.children(0), std::make_pair(1u, 4u));
+	EXPECT_EQ(index.name(1), "a");
+	EXPECT_EQ(index.name(2), "b");
+	EXPECT_EQ(index.name(3), "c.txt");
+	EXPECT_TRUE(index.isDirectory(1));
+	EXPECT_FALSE(index.isDirectory(3));
+	EXPECT_EQ(index.size(3), std::filesystem::file_size("localDir/test1.txt"));
+
+	uint32_t file = index.find("/b/d/file.txt");
+	ASSERT_NE(file, RemoteIndex::NONE);
+	EXPECT_EQ(index.path(file), "/b/d/file.txt");
+	EXPECT_EQ(index.size(file), std::filesystem::file_size("localDir/test0.txt"));
+	EXPECT_EQ(index.path(index.parent(file)), "/b/d");
+	EXPECT_EQ(index.find("b/d/"), index.parent(file));
+	EXPECT_EQ(index.find("/"), 0u);
+	EXPECT_EQ(index.find("/b/noexist"), RemoteIndex::NONE);
+	EXPECT_EQ(index.find("/c.txt/x"), RemoteIndex::NONE);
+}
+
+TEST_F(RemoteIndexTest, Build) {
+	auto index = CloudSync::RemoteIndex::build(client, "/");
+	ASSERT_TRUE(index);
+	checkIndex(*index);
+
+	EXPECT_FALSE(CloudSync::RemoteIndex::build(client, "/c.txt"));
+	EXPECT_FALSE(CloudSync::RemoteIndex::build(client, "/noexist"));
+}
+
+TEST_F(RemoteIndexTest, Subtree) {
+	auto index = CloudSync::RemoteIndex::build(client, "/b");
+	ASSERT_TRUE(index);
+	EXPECT_EQ(index->count(), 3u);
+	EXPECT_NE(index->find("/d/file.txt"), CloudSync::RemoteIndex::NONE);
+}
+
+TEST_F(RemoteIndexTest, SaveLoad) {
+	{
+		auto index = CloudSync::RemoteIndex::build(client, "/");
+		ASSERT_TRUE(index);
+		index->save(indexFname);
+	}
+
+	CloudSync::RemoteIndex index(indexFname);
+	checkIndex(index);
+
+	// Saving over the open index must not disturb it.
+	CloudSync::RemoteIndex::build(client, "/b")->save(indexFname);
+	checkIndex(index);
+	EXPECT_EQ(CloudSync::RemoteIndex(indexFname).count(), 3u);
+}
+
+TEST_F(RemoteIndexTest, Corrupt) {
+	EXPECT_THROW(CloudSync::RemoteIndex("noexist.idx"), CloudSync::fs::NotFoundException);
+
+	CloudSync::RemoteIndex::build(client, "/")->save(indexFname);
+	std::filesystem::resize_file(indexFname, std::filesystem::file_size(indexFname) - 1);
+	EXPECT_THROW(CloudSync::RemoteIndex{ indexFname }, CloudSync::fs::IOException);
+
+	std::ofstream(indexFname, std::ios_base::binary | std::ios_base::trunc) << "not an index at all, but long enough to have a header";
+	EXPECT_THROW(CloudSync::RemoteIndex{ indexFname }, CloudSync::fs::IOException);
+}
+
+#ifndef __MAIN_TEST__
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
+
+#endif
@@ -0,0 +1,142 @@
+/** @file tests/statedb_test.cpp
+ * @brief Tests StateDatabase.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "../statedb.hpp"
+#include "../fs/ioexception.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+
+constexpr const char* testFname = "state.db";
+constexpr const char* dataFname = "data.txt";
+
+class StateDatabaseTest : public ::testing::Test {
+protected:
+	StateDatabaseTest() {
+		std::remove(testFname);
+	}
+
+	~StateDatabaseTest() {
+		std::remove(testFname);
+		std::remove(dataFname);
+	}
+};
+
+static CloudSync::FileState makeState(uint64_t n) {
+	CloudSync::FileState state;
+	state.inode = n;
+	state.size = n * 10;
+	state.mtimeNs = n * 1000000007;
+	state.ctimeNs = n * 1000000009;
+	state.hash = "hash" + std::to_string(n);
+	return state;
+}
+
+static void expectState(const std::optional<CloudSync::FileState>& state, uint64_t n) {
+	ASSERT_TRUE(state);
+	EXPECT_EQ(state->inode, n);
+	EXPECT_EQ(state->size, n * 10);
+	EXPECT_EQ(state->mtimeNs, static_cast<int64_t>(n * 1000000007));
+	EXPECT_EQ(state->ctimeNs, static_cast<int64_t>(n * 1000000009));
+	EXPECT_EQ(state->hash, "hash" + std::to_string(n));
+}
+
+TEST_F(StateDatabaseTest, PutGet) {
+	{
+		CloudSync::StateDatabase db(testFname);
+		EXPECT_EQ(db.size(), 0u);
+		// Out of order, to check that the file ends up sorted anyway.
+		for (uint64_t i : { 5, 1, 9, 3, 7 }) {
+			db.put(("/dir/file" + std::to_string(i)).c_str(), makeState(i));
+		}
+		expectState(db.get("/dir/file9"), 9);
+		db.flush();
+		expectState(db.get("/dir/file9"), 9);
+	}
+
+	CloudSync::StateDatabase db(testFname);
+	EXPECT_EQ(db.size(), 5u);
+	for (uint64_t i : { 1, 3, 5, 7, 9 }) {
+		expectState(db.get(("/dir/file" + std::to_string(i)).c_str()), i);
+	}
+	EXPECT_FALSE(db.get("/dir/file2"));
+	EXPECT_FALSE(db.get("/dir/file"));
+	EXPECT_FALSE(db.get("/dir/file99"));
+}
+
+TEST_F(StateDatabaseTest, Merge) {
+	CloudSync::StateDatabase db(testFname);
+	for (uint64_t i = 0; i < 100; ++i) {
+		db.put(("/f" + std::to_string(i)).c_str(), makeState(i));
+	}
+	db.flush();
+
+	EXPECT_TRUE(db.remove("/f10"));
+	EXPECT_FALSE(db.remove("/f10"));
+	EXPECT_FALSE(db.remove("/noexist"));
+	db.put("/f20", makeState(1000));
+	db.put("/a_new", makeState(2000));
+	EXPECT_EQ(db.size(), 100u);
+	EXPECT_FALSE(db.get("/f10"));
+	expectState(db.get("/f20"), 1000);
+	db.flush();
+
+	CloudSync::StateDatabase reopened(testFname);
+	EXPECT_EQ(reopened.size(), 100u);
+	EXPECT_FALSE(reopened.get("/f10"));
+	expectState(reopened.get("/f20"), 1000);
+	expectState(reopened.get("/a_new"), 2000);
+	expectState(reopened.get("/f99"), 99);
+	expectState(reopened.get("/f0"), 0);
+}
+
+TEST_F(StateDatabaseTest, Unchanged) {
+	struct stat st;
+	CloudSync::StateDatabase db(testFname);
+
+	std::ofstream(dataFname) << "contents";
+	ASSERT_EQ(stat(dataFname, &st), 0);
+	db.put(dataFname, CloudSync::FileState::fromStat(st, "abc"));
+	db.flush();
+
+	ASSERT_EQ(stat(dataFname, &st), 0);
+	auto state = db.getUnchanged(dataFname, st);
+	ASSERT_TRUE(state);
+	EXPECT_EQ(state->hash, "abc");
+
+	// A different size is a change even if the times were to match.
+	st.st_size++;
+	EXPECT_FALSE(db.getUnchanged(dataFname, st));
+	st.st_size--;
+	st.st_ctim.tv_nsec = (st.st_ctim.tv_nsec + 1) % 1000000000;
+	EXPECT_FALSE(db.getUnchanged(dataFname, st));
+	EXPECT_FALSE(db.getUnchanged("noexist.txt", st));
+}
+
+TEST_F(StateDatabaseTest, Corrupt) {
+	{
+		CloudSync::StateDatabase db(testFname);
+		db.put("/a", makeState(1));
+		db.flush();
+	}
+	std::filesystem::resize_file(testFname, std::filesystem::file_size(testFname) - 1);
+	EXPECT_THROW(CloudSync::StateDatabase{ testFname }, CloudSync::fs::IOException);
+
+	std::ofstream(testFname, std::ios_base::binary | std::ios_base::trunc) << "definitely not a state database file";
+	EXPECT_THROW(CloudSync::StateDatabase{ testFname }, CloudSync::fs::IOException);
+}
+
+#ifndef __MAIN_TEST__
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
+
+#endif
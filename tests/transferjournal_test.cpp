@@ -0,0 +1,94 @@
+/** @file transferjournal_test.cpp
+ * @brief tests transferjournal
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "../transferjournal.hpp"
+#include <cstdio>
+#include <gtest/gtest.h>
+
+constexpr const char* testFname = "journal.cf";
+
+class TransferJournalTest : public ::testing::Test {
+protected:
+	TransferJournalTest() {
+		std::remove(testFname);
+	}
+
+	~TransferJournalTest() {
+		std::remove(testFname);
+	}
+};
+
+static CloudSync::TransferRecord makeRecord() {
+	CloudSync::TransferRecord record;
+	record.type = CloudSync::TransferType::Download;
+	record.diskPath = "/tmp/big.bin";
+	record.cloudPath = "/backups/big.bin";
+	record.size = 1000;
+	record.mtime = 1234567890;
+	record.sourceId = 42;
+	record.pending = { { 100, 500 }, { 750, 1000 } };
+	return record;
+}
+
+TEST_F(TransferJournalTest, PutGet) {
+	{
+		CloudSync::TransferJournal tj(testFname);
+		tj.put(makeRecord());
+		tj.flush();
+	}
+
+	CloudSync::TransferJournal tj(testFname);
+	auto record = tj.get(CloudSync::TransferType::Download, "/tmp/big.bin", "/backups/big.bin");
+	ASSERT_TRUE(record);
+	EXPECT_EQ(record->cloudPath, "/backups/big.bin");
+	EXPECT_EQ(record->size, 1000u);
+	EXPECT_EQ(record->mtime, 1234567890);
+	EXPECT_EQ(record->sourceId, 42u);
+	EXPECT_EQ(record->pending, makeRecord().pending);
+	EXPECT_EQ(record->remaining(), 650u);
+
+	EXPECT_FALSE(tj.get(CloudSync::TransferType::Upload, "/tmp/big.bin", "/backups/big.bin"));
+	EXPECT_EQ(tj.getRecords().size(), 1u);
+}
+
+TEST_F(TransferJournalTest, Update) {
+	CloudSync::TransferJournal tj(testFname);
+	CloudSync::TransferRecord record = makeRecord();
+
+	tj.put(record);
+	record.pending = { { 900, 1000 } };
+	tj.put(record);
+
+	auto ret = tj.get(CloudSync::TransferType::Download, "/tmp/big.bin", "/backups/big.bin");
+	ASSERT_TRUE(ret);
+	EXPECT_EQ(ret->remaining(), 100u);
+	EXPECT_EQ(tj.getRecords().size(), 1u);
+}
+
+TEST_F(TransferJournalTest, Remove) {
+	{
+		CloudSync::TransferJournal tj(testFname);
+		tj.put(makeRecord());
+		tj.flush();
+		EXPECT_TRUE(tj.remove(CloudSync::TransferType::Download, "/tmp/big.bin", "/backups/big.bin"));
+		EXPECT_FALSE(tj.remove(CloudSync::TransferType::Download, "/tmp/big.bin", "/backups/big.bin"));
+		tj.flush();
+	}
+
+	CloudSync::TransferJournal tj(testFname);
+	EXPECT_TRUE(tj.getRecords().empty());
+}
+
+#ifndef __MAIN_TEST__
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
+
+#endif
@@ -0,0 +1,230 @@
+/** @file tests/transferqueue_test.cpp
+ * @brief Tests TransferQueue.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "../localdirclient.hpp"
+#include "../netsimclient.hpp"
+#include "../transferqueue.hpp"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <thread>
+
+constexpr const char* cloudDir = "cloudDir";
+constexpr const char* localDir = "localDir";
+
+class TransferQueueTest : public testing::Test {
+protected:
+	TransferQueueTest(): local(cloudDir) {}
+
+	virtual void SetUp() override {
+		ASSERT_TRUE(local.login("", ""));
+		std::filesystem::create_directory(localDir);
+		for (int i = 0; i < 64; ++i) {
+			std::ofstream(std::string(localDir) + "/" + std::to_string(i)) << std::string(1000, 'x');
+		}
+	}
+
+	virtual void TearDown() override {
+		std::filesystem::remove_all(cloudDir);
+		std::filesystem::remove_all(localDir);
+	}
+
+	static void addAll(CloudSync::TransferQueue& tq) {
+		for (int i = 0; i < 64; ++i) {
+			std::string name = std::to_string(i);
+			tq.addUpload((std::string(localDir) + "/" + name).c_str(), ("/" + name).c_str());
+		}
+	}
+
+	CloudSync::LocalDirClient local;
+};
+
+/**
+ * @brief Forwards to another client, holding every transfer open for a while and counting how many are open at once.
+ */
+class CountingClient : public CloudSync::BaseClient {
+public:
+	CountingClient(CloudSync::BaseClient& client): client(client) {}
+
+	bool login(const char* username, const char* password) override { return client.login(username, password); }
+	bool mkdir(const char* dir) override { return client.mkdir(dir); }
+	std::optional<std::vector<std::string>> readdir(const char* dir) override { return client.readdir(dir); }
+	bool stat(const char* path, struct stat* st) override { return client.stat(path, st); }
+	bool move(const char* oldPath, const char* newPath) override { return client.move(oldPath, newPath); }
+	bool remove(const char* path) override { return client.remove(path); }
+	bool logout() override { return client.logout(); }
+
+	bool download(const char* cloudPath, const char* diskPath) override {
+		Open o(*this);
+		return client.download(cloudPath, diskPath);
+	}
+
+	bool upload(const char* diskPath, const char* cloudPath) override {
+		Open o(*this);
+		return client.upload(diskPath, cloudPath);
+	}
+
+	void congest() {
+		reportCongestion();
+	}
+
+	std::atomic<int> open{ 0 };
+	std::atomic<int> maxOpen{ 0 };
+	/**
+	 * @brief How long every transfer is held open.
+	 */
+	std::chrono::microseconds hold{ 2000 };
+
+private:
+	struct Open {
+		Open(CountingClient& c): c(c) {
+			int now = ++c.open;
+			int prev = c.maxOpen;
+			while (now > prev && !c.maxOpen.compare_exchange_weak(prev, now)) {}
+			std::this_thread::sleep_for(c.hold);
+		}
+		~Open() {
+			c.open--;
+		}
+		CountingClient& c;
+	};
+
+	CloudSync::BaseClient& client;
+};
+
+TEST_F(TransferQueueTest, Limit) {
+	CountingClient client(local);
+	CloudSync::TransferQueue tq(client, 4);
+	addAll(tq);
+
+	EXPECT_EQ(tq.run().completed, 64u);
+	EXPECT_LE(client.maxOpen, 4);
+	EXPECT_GT(client.maxOpen, 1);
+	EXPECT_EQ(client.open, 0);
+}
+
+TEST_F(TransferQueueTest, Completion) {
+	CountingClient client(local);
+	std::atomic<int> succeeded{ 0 };
+	std::atomic<int> failed{ 0 };
+
+	{
+		CloudSync::TransferQueue tq(client, 8);
+		tq.setJobCallback([&](const CloudSync::TransferJob&, bool res) {
+			(res ? succeeded : failed)++;
+		});
+		addAll(tq);
+		tq.addDownload("/noexist", "localDir/noexist");
+
+		CloudSync::TransferStats stats = tq.run();
+		// run() must not return before every job has reported back.
+		EXPECT_EQ(stats.completed, 64u);
+		EXPECT_EQ(stats.failed, 1u);
+		EXPECT_EQ(succeeded, 64);
+		EXPECT_EQ(failed, 1);
+		// The queue is destroyed right after its last job finishes, which must not race with that job's thread.
+	}
+	EXPECT_EQ(client.open, 0);
+}
+
+TEST_F(TransferQueueTest, Fixed) {
+	CloudSync::TransferQueue tq(local, 4);
+	addAll(tq);
+
+	CloudSync::TransferStats stats = tq.run();
+	EXPECT_EQ(stats.completed, 64u);
+	EXPECT_EQ(stats.bytes, 64000u);
+	EXPECT_EQ(tq.getMaxConcurrent(), 4);
+}
+
+TEST_F(TransferQueueTest, AdaptiveIncrease) {
+	CloudSync::NetSimConfig config;
+	config.latencyMs = 10;
+	CloudSync::NetSimClient client(local, config);
+	CloudSync::TransferQueue tq(client, 1);
+
+	// Latency-bound transfers get faster with every transfer added.
+	tq.setAdaptiveConcurrency(1, 16, std::chrono::milliseconds(15));
+	addAll(tq);
+
+	CloudSync::TransferStats stats = tq.run();
+	EXPECT_EQ(stats.completed, 64u);
+	EXPECT_GT(tq.getMaxConcurrent(), 1);
+}
+
+TEST_F(TransferQueueTest, AdaptiveIncreaseBackToBack) {
+	CountingClient client(local);
+	CloudSync::TransferQueue tq(client, 1);
+
+	// Jobs finish well under a millisecond apart, so run() is woken up by a finished job long before any wait times out.
+	client.hold = std::chrono::microseconds(300);
+	tq.setAdaptiveConcurrency(1, 16, std::chrono::milliseconds(5));
+	for (int i = 0; i < 512; ++i) {
+		tq.addUpload((std::string(localDir) + "/" + std::to_string(i % 64)).c_str(), ("/" + std::to_string(i)).c_str());
+	}
+
+	CloudSync::TransferStats stats = tq.run();
+	EXPECT_EQ(stats.completed, 512u);
+	EXPECT_GT(tq.getMaxConcurrent(), 2);
+}
+
+TEST_F(TransferQueueTest, AdaptiveDecrease) {
+	CloudSync::NetSimConfig config;
+	config.failureRate = 1;
+	config.latencyMs = 5;
+	CloudSync::NetSimClient client(local, config);
+	CloudSync::TransferQueue tq(client, 16);
+
+	// Every wave of failures spans a few epochs, and each epoch halves the concurrency at most once.
+	tq.setAdaptiveConcurrency(2, 16, std::chrono::milliseconds(1));
+	addAll(tq);
+
+	CloudSync::TransferStats stats = tq.run();
+	EXPECT_EQ(stats.failed, 64u);
+	EXPECT_EQ(tq.getMaxConcurrent(), 2);
+
+	tq.setAdaptiveConcurrency(0, 0);
+	tq.setMaxConcurrent(8);
+	tq.reportCongestion();
+	EXPECT_EQ(tq.getMaxConcurrent(), 8);
+}
+
+TEST_F(TransferQueueTest, SharedClient) {
+	CountingClient client(local);
+	auto first = std::make_unique<CloudSync::TransferQueue>(client, 8);
+	CloudSync::TransferQueue second(client, 8);
+
+	first->setAdaptiveConcurrency(1, 16, std::chrono::hours(1));
+	second.setAdaptiveConcurrency(1, 16, std::chrono::hours(1));
+	client.congest();
+	EXPECT_EQ(first->getMaxConcurrent(), 4);
+	EXPECT_EQ(second.getMaxConcurrent(), 4);
+
+	// Destroying one queue must leave the other one's observer in place.
+	first.reset();
+	second.setAdaptiveConcurrency(1, 16, std::chrono::hours(1));
+	client.congest();
+	EXPECT_EQ(second.getMaxConcurrent(), 2);
+
+	second.setAdaptiveConcurrency(0, 0);
+	second.setMaxConcurrent(8);
+	client.congest();
+	EXPECT_EQ(second.getMaxConcurrent(), 8);
+}
+
+#ifndef __MAIN_TEST__
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
+
+#endif
@@ -0,0 +1,157 @@
+/** @file tests/transferscheduler_test.cpp
+ * @brief Tests TransferScheduler.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "../localdirclient.hpp"
+#include "../transferscheduler.hpp"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+constexpr const char* cloudDir = "cloudDir";
+constexpr const char* localDir = "localDir";
+
+class TransferSchedulerTest : public testing::Test {
+protected:
+	TransferSchedulerTest(): local(cloudDir) {}
+
+	virtual void SetUp() override {
+		ASSERT_TRUE(local.login("", ""));
+		std::filesystem::create_directory(localDir);
+	}
+
+	virtual void TearDown() override {
+		std::filesystem::remove_all(cloudDir);
+		std::filesystem::remove_all(localDir);
+	}
+
+	static std::string makeFile(const std::string& name, size_t size) {
+		std::string path = std::string(localDir) + "/" + name;
+		std::ofstream(path) << std::string(size, 'x');
+		return path;
+	}
+
+	CloudSync::LocalDirClient local;
+};
+
+TEST_F(TransferSchedulerTest, LaneOrder) {
+	CloudSync::TransferScheduler ts(local, 1000, 1, 1);
+	std::vector<std::string> small;
+	std::vector<std::string> large;
+	std::mutex m;
+
+	ts.addUpload(makeFile("l1", 2000).c_str(), "/l1");
+	ts.addUpload(makeFile("s3", 300).c_str(), "/s3");
+	ts.addUpload(makeFile("l3", 4000).c_str(), "/l3");
+	ts.addUpload(makeFile("s1", 100).c_str(), "/s1");
+	ts.addUpload(makeFile("l2", 3000).c_str(), "/l2");
+	ts.addUpload(makeFile("s2", 200).c_str(), "/s2");
+	ts.setJobCallback([&](const CloudSync::TransferJob& job, bool res) {
+		EXPECT_TRUE(res);
+		std::lock_guard<std::mutex> lock(m);
+		(job.cloudPath[1] == 's' ? small : large).push_back(job.cloudPath);
+	});
+
+	CloudSync::TransferStats stats = ts.run();
+	EXPECT_EQ(stats.completed, 6u);
+	EXPECT_EQ(stats.failed, 0u);
+	EXPECT_EQ(stats.bytes, 9600u);
+	// Small files go smallest first, large files largest first.
+	// Only the first of each lane is certain, as a lane that runs dry lets the other run more at once.
+	ASSERT_EQ(small.size(), 3u);
+	ASSERT_EQ(large.size(), 3u);
+	EXPECT_EQ(small.front(), "/s1");
+	EXPECT_EQ(large.front(), "/l3");
+}
+
+TEST_F(TransferSchedulerTest, Downloads) {
+	CloudSync::TransferScheduler ts(local, 1024);
+	struct stat st;
+
+	ASSERT_TRUE(local.upload(makeFile("a", 10).c_str(), "/a"));
+	ASSERT_TRUE(local.upload(makeFile("b", 4096).c_str(), "/b"));
+	ts.addDownload("/a", "localDir/a2");
+	ts.addDownload("/b", "localDir/b2", 4096);
+	ts.addDownload("/noexist", "localDir/c2");
+
+	CloudSync::TransferStats stats = ts.run();
+	EXPECT_EQ(stats.completed, 2u);
+	EXPECT_EQ(stats.failed, 1u);
+	ASSERT_EQ(::stat("localDir/b2", &st), 0);
+	EXPECT_EQ(st.st_size, 4096);
+}
+
+/**
+ * @brief Forwards to another client, counting the metadata requests made through it.
+ */
+class CountingClient : public CloudSync::BaseClient {
+public:
+	CountingClient(CloudSync::BaseClient& client): client(client) {}
+
+	bool login(const char* username, const char* password) override { return client.login(username, password); }
+	bool mkdir(const char* dir) override { return client.mkdir(dir); }
+	std::optional<std::vector<std::string>> readdir(const char* dir) override { return client.readdir(dir); }
+	bool move(const char* oldPath, const char* newPath) override { return client.move(oldPath, newPath); }
+	bool download(const char* cloudPath, const char* diskPath) override { return client.download(cloudPath, diskPath); }
+	bool upload(const char* diskPath, const char* cloudPath) override { return client.upload(diskPath, cloudPath); }
+	bool remove(const char* path) override { return client.remove(path); }
+	bool logout() override { return client.logout(); }
+
+	bool stat(const char* path, struct stat* st) override {
+		stats++;
+		return client.stat(path, st);
+	}
+
+	std::optional<std::vector<CloudSync::DirEntry>> readdirPlus(const char* dir) override {
+		listings++;
+		return client.readdirPlus(dir);
+	}
+
+	std::atomic<int> stats{ 0 };
+	std::atomic<int> listings{ 0 };
+
+private:
+	CloudSync::BaseClient& client;
+};
+
+TEST_F(TransferSchedulerTest, DownloadSizing) {
+	CountingClient client(local);
+	CloudSync::TransferScheduler ts(client, 1024);
+
+	ASSERT_TRUE(local.mkdir("/dir"));
+	for (const char* name : { "x", "y", "z" }) {
+		ASSERT_TRUE(local.upload(makeFile(name, 10).c_str(), (std::string("/dir/") + name).c_str()));
+	}
+	ASSERT_TRUE(local.upload(makeFile("big", 4096).c_str(), "/dir/big"));
+	ASSERT_TRUE(local.upload(makeFile("lone", 10).c_str(), "/lone"));
+	ts.addDownload("/dir/x", "localDir/x2");
+	ts.addDownload("/dir/big", "localDir/big2");
+	ts.addDownload("/dir/y", "localDir/y2");
+	ts.addDownload("/dir/noexist", "localDir/noexist2");
+	ts.addDownload("/lone", "localDir/lone2");
+
+	CloudSync::TransferStats stats = ts.run();
+	EXPECT_EQ(stats.completed, 4u);
+	EXPECT_EQ(stats.failed, 1u);
+	EXPECT_EQ(stats.bytes, 4096u + 30u);
+	// The four downloads from /dir share one listing, and only the lone file is stat()ed.
+	EXPECT_EQ(client.listings, 1);
+	EXPECT_EQ(client.stats, 1);
+}
+
+#ifndef __MAIN_TEST__
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
+
+#endif
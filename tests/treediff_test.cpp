@@ -0,0 +1,186 @@
+/** @file tests/treediff_test.cpp
+ * @brief Tests TreeDiff.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "../treediff.hpp"
+#include "../localdirclient.hpp"
+#include "../fs/notfoundexception.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <utime.h>
+
+constexpr const char* cloudDir = "cloudDir";
+constexpr const char* localDir = "localDir";
+
+class TreeDiffTest : public testing::Test {
+protected:
+	TreeDiffTest(): client(cloudDir) {}
+
+	virtual void SetUp() override {
+		ASSERT_TRUE(client.login("", ""));
+		std::filesystem::create_directory(localDir);
+	}
+
+	virtual void TearDown() override {
+		std::filesystem::remove_all(cloudDir);
+		std::filesystem::remove_all(localDir);
+	}
+
+	/**
+	 * @brief Creates a file under the local or cloud directory with the given contents and mtime, along with its parents.
+	 */
+	static void makeFile(const char* base, const char* path, const char* contents, time_t mtime) {
+		std::filesystem::path full = std::filesystem::path(base) / (path + 1);
+		struct utimbuf times = { mtime, mtime };
+
+		std::filesystem::create_directories(full.parent_path());
+		std::ofstream(full, std::ios_base::binary) << contents;
+		ASSERT_EQ(utime(full.c_str(), &times), 0);
+	}
+
+	static void makeDir(const char* base, const char* path) {
+		std::filesystem::create_directories(std::filesystem::path(base) / (path + 1));
+	}
+
+	CloudSync::LocalDirClient client;
+};
+
+/**
+ * @brief Describes a plan as one string per operation, which makes for readable failures.
+ */
+static std::vector<std::string> describe(const std::vector<CloudSync::SyncOp>& ops) {
+	using CloudSync::SyncOpType;
+	std::vector<std::string> ret;
+
+	for (const auto& op : ops) {
+		std::string s;
+		switch (op.type) {
+		case SyncOpType::MkdirLocal: s = "mkdir local "; break;
+		case SyncOpType::MkdirRemote: s = "mkdir remote "; break;
+		case SyncOpType::MoveLocal: s = "move local " + op.from + " -> "; break;
+		case SyncOpType::MoveRemote: s = "move remote " + op.from + " -> "; break;
+		case SyncOpType::Upload: s = "upload "; break;
+		case SyncOpType::Download: s = "download "; break;
+		case SyncOpType::DeleteLocal: s = "delete local "; break;
+		case SyncOpType::DeleteRemote: s = "delete remote "; break;
+		case SyncOpType::Conflict: s = "conflict "; break;
+		}
+		ret.push_back(s + op.path);
+	}
+	return ret;
+}
+
+TEST_F(TreeDiffTest, Upload) {
+	makeFile(localDir, "/same.txt", "same", 1000);
+	makeFile(cloudDir, "/same.txt", "same", 1000);
+	makeFile(localDir, "/changed.txt", "changed", 1000);
+	makeFile(cloudDir, "/changed.txt", "change", 1000);
+	makeFile(localDir, "/new.txt", "brand new", 1000);
+	makeDir(localDir, "/newdir");
+	makeFile(localDir, "/renamed.txt", "moved contents", 2000);
+	makeFile(cloudDir, "/old/moved.txt", "moved contents", 2000);
+	makeFile(cloudDir, "/old/other.txt", "other", 1000);
+	makeFile(cloudDir, "/gone.txt", "gone for good", 1000);
+	makeFile(localDir, "/clash/f.txt", "f", 1000);
+	makeFile(cloudDir, "/clash", "a file", 1000);
+	// Sorts between "/clash" and "/clash/f.txt" byte-wise, but not depth-first.
+	makeFile(cloudDir, "/clash.txt", "x", 3000);
+	makeFile(localDir, "/clash.txt", "x", 3000);
+
+	auto plan = CloudSync::TreeDiff(localDir).diff(client, "/");
+	ASSERT_TRUE(plan);
+	EXPECT_EQ(describe(*plan), std::vector<std::string>({
+		"delete remote /clash",
+		"mkdir remote /clash",
+		"mkdir remote /newdir",
+		"move remote /old/moved.txt -> /renamed.txt",
+		"upload /changed.txt",
+		"upload /clash/f.txt",
+		"upload /new.txt",
+		"delete remote /gone.txt",
+		"delete remote /old",
+	}));
+
+	plan = CloudSync::TreeDiff(localDir).setMoveDetection(false).diff(client, "/");
+	ASSERT_TRUE(plan);
+	std::vector<std::string> ops = describe(*plan);
+	EXPECT_EQ(std::count(ops.begin(), ops.end(), "upload /renamed.txt"), 1);
+	EXPECT_EQ(std::count(ops.begin(), ops.end(), "delete remote /old"), 1);
+}
+
+TEST_F(TreeDiffTest, Download) {
+	makeFile(cloudDir, "/a/new.txt", "new", 1000);
+	makeFile(localDir, "/b/moved.txt", "moved", 1000);
+	makeFile(cloudDir, "/a/moved.txt", "moved", 1000);
+	makeFile(localDir, "/b/stale.txt", "stale", 1000);
+
+	auto plan = CloudSync::TreeDiff(localDir, CloudSync::SyncDirection::Download).diff(client, "/");
+	ASSERT_TRUE(plan);
+	// Two files share a size and mtime, so neither is taken for a move.
+	EXPECT_EQ(describe(*plan), std::vector<std::string>({
+		"mkdir local /a",
+		"download /a/moved.txt",
+		"download /a/new.txt",
+		"delete local /b",
+	}));
+}
+
+TEST_F(TreeDiffTest, Bidirectional) {
+	makeFile(localDir, "/local.txt", "local", 1000);
+	makeFile(cloudDir, "/remote/r.txt", "remote", 1000);
+	makeFile(localDir, "/newer_local.txt", "new", 2000);
+	makeFile(cloudDir, "/newer_local.txt", "old", 1000);
+	makeFile(localDir, "/newer_remote.txt", "old", 1000);
+	makeFile(cloudDir, "/newer_remote.txt", "new", 2000);
+	makeFile(localDir, "/both.txt", "one", 1000);
+	makeFile(cloudDir, "/both.txt", "other", 1000);
+	makeFile(localDir, "/kind", "file", 1000);
+	makeFile(cloudDir, "/kind/inside.txt", "inside", 1000);
+
+	auto plan = CloudSync::TreeDiff(localDir, CloudSync::SyncDirection::Bidirectional).diff(client, "/");
+	ASSERT_TRUE(plan);
+	EXPECT_EQ(describe(*plan), std::vector<std::string>({
+		"mkdir local /remote",
+		"upload /local.txt",
+		"upload /newer_local.txt",
+		"download /newer_remote.txt",
+		"download /remote/r.txt",
+		"conflict /both.txt",
+		"conflict /kind",
+	}));
+}
+
+TEST_F(TreeDiffTest, Index) {
+	makeFile(localDir, "/x/y.txt", "y", 1000);
+	makeFile(cloudDir, "/z.txt", "zz", 1000);
+	makeDir(cloudDir, "/sub");
+	makeFile(cloudDir, "/sub/x/y.txt", "y", 1000);
+
+	auto index = CloudSync::RemoteIndex::build(client, "/sub");
+	ASSERT_TRUE(index);
+	EXPECT_TRUE(CloudSync::TreeDiff(localDir).diff(*index).empty());
+	EXPECT_EQ(describe(*CloudSync::TreeDiff(localDir).diff(client, "/")), std::vector<std::string>({
+		"mkdir remote /x",
+		"move remote /sub/x/y.txt -> /x/y.txt",
+		"delete remote /sub",
+		"delete remote /z.txt",
+	}));
+
+	EXPECT_FALSE(CloudSync::TreeDiff(localDir).diff(client, "/noexist"));
+	EXPECT_THROW(CloudSync::TreeDiff("noexist").diff(*index), CloudSync::fs::NotFoundException);
+}
+
+#ifndef __MAIN_TEST__
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
+
+#endif
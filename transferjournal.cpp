@@ -0,0 +1,216 @@
+/** @file transferjournal.cpp
+ * @brief Records the progress of transfers so they can be resumed after an interruption.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "transferjournal.hpp"
+#include "config.hpp"
+#include "logger.hpp"
+#include <cstring>
+#include <mutex>
+
+namespace CloudSync {
+
+/**
+ * @brief The prefix of every journal key, so the journal can share a ConfigFile with other data.
+ */
+constexpr const char JOURNAL_PREFIX[] = "xfer\n";
+
+/**
+ * @brief Makes the ConfigFile key of a transfer.
+ * Newlines cannot appear in either path in practice, so they separate the components.
+ */
+static std::string make_key(TransferType type, const char* diskPath, const char* cloudPath) {
+	std::string ret(JOURNAL_PREFIX);
+	ret += type == TransferType::Upload ? 'u' : 'd';
+	ret += '\n';
+	ret += diskPath;
+	ret += '\n';
+	ret += cloudPath;
+	return ret;
+}
+
+template <typename T>
+static void put_bytes(std::vector<unsigned char>& out, const T& val) {
+	const unsigned char* ptr = reinterpret_cast<const unsigned char*>(&val);
+	out.insert(out.end(), ptr, ptr + sizeof(val));
+}
+
+static void put_string(std::vector<unsigned char>& out, const std::string& s) {
+	put_bytes(out, static_cast<uint64_t>(s.size()));
+	out.insert(out.end(), s.begin(), s.end());
+}
+
+/**
+ * @brief Reads values out of a serialized record, failing instead of reading past the end.
+ */
+class RecordReader {
+public:
+	RecordReader(const std::vector<unsigned char>& data): data(data) {}
+
+	template <typename T>
+	bool get(T& val) {
+		if (data.size() - pos < sizeof(val)) {
+			return false;
+		}
+		std::memcpy(&val, data.data() + pos, sizeof(val));
+		pos += sizeof(val);
+		return true;
+	}
+
+	bool getString(std::string& s) {
+		uint64_t len;
+		if (!get(len) || data.size() - pos < len) {
+			return false;
+		}
+		s.assign(reinterpret_cast<const char*>(data.data() + pos), len);
+		pos += len;
+		return true;
+	}
+
+	bool atEnd() const {
+		return pos == data.size();
+	}
+
+private:
+	const std::vector<unsigned char>& data;
+	size_t pos = 0;
+};
+
+/**
+ * @brief Serializes a record as
+ * ```
+ * <1-byte type><8-byte size><8-byte mtime><8-byte source id><8-byte length><disk path><8-byte length><cloud path><8-byte count>(<8-byte begin><8-byte end>)...
+ * ```
+ */
+static std::vector<unsigned char> serialize(const TransferRecord& record) {
+	std::vector<unsigned char> ret;
+	put_bytes(ret, static_cast<uint8_t>(record.type == TransferType::Upload ? 'u' : 'd'));
+	put_bytes(ret, record.size);
+	put_bytes(ret, record.mtime);
+	put_bytes(ret, record.sourceId);
+	put_string(ret, record.diskPath);
+	put_string(ret, record.cloudPath);
+	put_bytes(ret, static_cast<uint64_t>(record.pending.size()));
+	for (const auto& range : record.pending) {
+		put_bytes(ret, range.first);
+		put_bytes(ret, range.second);
+	}
+	return ret;
+}
+
+static std::optional<TransferRecord> deserialize(const std::vector<unsigned char>& data) {
+	RecordReader rr(data);
+	TransferRecord ret;
+	uint8_t type;
+	uint64_t count;
+
+	if (!rr.get(type) || (type != 'u' && type != 'd') ||
+		!rr.get(ret.size) || !rr.get(ret.mtime) || !rr.get(ret.sourceId) ||
+		!rr.getString(ret.diskPath) || !rr.getString(ret.cloudPath) ||
+		!rr.get(count)) {
+		return std::nullopt;
+	}
+	ret.type = type == 'u' ? TransferType::Upload : TransferType::Download;
+
+	for (uint64_t i = 0; i < count; ++i) {
+		std::pair<uint64_t, uint64_t> range;
+		if (!rr.get(range.first) || !rr.get(range.second) || range.first > range.second || range.second > ret.size) {
+			return std::nullopt;
+		}
+		ret.pending.push_back(range);
+	}
+
+	if (!rr.atEnd()) {
+		return std::nullopt;
+	}
+	return ret;
+}
+
+uint64_t TransferRecord::remaining() const {
+	uint64_t ret = 0;
+	for (const auto& range : pending) {
+		ret += range.second - range.first;
+	}
+	return ret;
+}
+
+struct TransferJournal::TransferJournalImpl {
+	TransferJournalImpl(const char* path): cf(path) {}
+
+	/**
+	 * @brief The file the records are kept in.
+	 */
+	ConfigFile cf;
+
+	/**
+	 * @brief Guards cf, as transfers report their progress from several threads.
+	 */
+	mutable std::mutex m;
+};
+
+TransferJournal::TransferJournal(const char* path): impl(std::make_unique<TransferJournalImpl>(path)) {}
+
+TransferJournal::TransferJournal(TransferJournal&& other) noexcept = default;
+
+TransferJournal& TransferJournal::operator=(TransferJournal&& other) noexcept = default;
+
+TransferJournal::~TransferJournal() = default;
+
+void TransferJournal::put(const TransferRecord& record) {
+	std::string key = make_key(record.type, record.diskPath.c_str(), record.cloudPath.c_str());
+	std::vector<unsigned char> data = serialize(record);
+
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->cf.writeEntry(key.c_str(), data);
+}
+
+std::optional<TransferRecord> TransferJournal::get(TransferType type, const char* diskPath, const char* cloudPath) const {
+	std::string key = make_key(type, diskPath, cloudPath);
+	std::optional<TransferRecord> ret;
+
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	auto data = this->impl->cf.readEntry(key.c_str());
+	if (!data) {
+		return std::nullopt;
+	}
+
+	ret = deserialize(data->get());
+	if (!ret) {
+		LOG(LEVEL_WARNING) << "The journal record for \"" << diskPath << "\" is corrupt and will be ignored";
+	}
+	return ret;
+}
+
+bool TransferJournal::remove(TransferType type, const char* diskPath, const char* cloudPath) {
+	std::string key = make_key(type, diskPath, cloudPath);
+
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	return this->impl->cf.removeEntry(key.c_str());
+}
+
+std::vector<TransferRecord> TransferJournal::getRecords() const {
+	std::vector<TransferRecord> ret;
+
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	for (const std::string& key : this->impl->cf.getKeys()) {
+		if (key.compare(0, std::strlen(JOURNAL_PREFIX), JOURNAL_PREFIX) != 0) {
+			continue;
+		}
+		auto record = deserialize(this->impl->cf.readEntry(key.c_str())->get());
+		if (record) {
+			ret.push_back(std::move(record.value()));
+		}
+	}
+	return ret;
+}
+
+void TransferJournal::flush() {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->cf.flush();
+}
+
+}
@@ -0,0 +1,115 @@
+/** @file transferjournal.hpp
+ * @brief Records the progress of transfers so they can be resumed after an interruption.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#ifndef __CS_TRANSFERJOURNAL_HPP
+#define __CS_TRANSFERJOURNAL_HPP
+
+#include "transferqueue.hpp"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace CloudSync{
+
+/**
+ * @brief The progress of a single unfinished transfer.
+ */
+struct TransferRecord {
+	TransferType type = TransferType::Download;
+	std::string diskPath;
+	std::string cloudPath;
+	/**
+	 * @brief The size of the file being transferred in bytes.
+	 */
+	uint64_t size = 0;
+	/**
+	 * @brief The modification time of the source when the transfer started.
+	 * If the source changed since, the progress is worthless and the transfer must start over.
+	 */
+	int64_t mtime = 0;
+	/**
+	 * @brief Identifies the source beyond its path, such as the handle of a cloud node. 0 if unused.
+	 */
+	uint64_t sourceId = 0;
+	/**
+	 * @brief The byte ranges that still have to be transferred as [begin, end) pairs.
+	 */
+	std::vector<std::pair<uint64_t, uint64_t>> pending;
+
+	/**
+	 * @brief Returns the number of bytes that still have to be transferred.
+	 */
+	uint64_t remaining() const;
+};
+
+/**
+ * @brief A ConfigFile-backed journal of unfinished transfers.
+ * A record is put in the journal when a transfer starts, updated as it progresses, and removed once it finishes.
+ * Whatever is left in the journal after a crash or a failed transfer can be resumed from where it stopped.
+ * This class is thread-safe.
+ */
+class TransferJournal {
+public:
+	/**
+	 * @brief Opens a transfer journal, creating it if it does not exist.
+	 *
+	 * @param path The path of the journal.
+	 *
+	 * @exception fs::ExistsException The file at the path is not a journal.
+	 * @exception fs::IOException There was an I/O error reading the journal.
+	 */
+	TransferJournal(const char* path);
+
+	TransferJournal(TransferJournal&& other) noexcept;
+	TransferJournal& operator=(TransferJournal&& other) noexcept;
+	~TransferJournal();
+
+	/**
+	 * @brief Adds a record to the journal, replacing the record of the same transfer if there is one.
+	 * The change is not written to disk until flush() is called.
+	 */
+	void put(const TransferRecord& record);
+
+	/**
+	 * @brief Gets the record of a transfer.
+	 *
+	 * @return The record, or std::nullopt if the transfer is not in the journal or its record is corrupt.
+	 */
+	std::optional<TransferRecord> get(TransferType type, const char* diskPath, const char* cloudPath) const;
+
+	/**
+	 * @brief Removes the record of a transfer.
+	 * The change is not written to disk until flush() is called.
+	 *
+	 * @return True if the transfer was in the journal, false if not.
+	 */
+	bool remove(TransferType type, const char* diskPath, const char* cloudPath);
+
+	/**
+	 * @brief Gets every readable record in the journal.
+	 */
+	std::vector<TransferRecord> getRecords() const;
+
+	/**
+	 * @brief Writes pending changes to disk.
+	 *
+	 * @exception fs::IOException There was an I/O error writing the journal.
+	 */
+	void flush();
+
+private:
+	struct TransferJournalImpl;
+	std::unique_ptr<TransferJournalImpl> impl;
+};
+
+}
+
+#endif
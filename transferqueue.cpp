@@ -0,0 +1,401 @@
+/** @file transferqueue.cpp
+ * @brief Runs many transfers with a bounded number in flight.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "transferqueue.hpp"
+#include "fs/file.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+
+namespace CloudSync {
+
+double TransferStats::bytesPerSecond() const noexcept {
+	double seconds = std::chrono::duration<double>(elapsed).count();
+	return seconds > 0 ? bytes / seconds : 0;
+}
+
+struct TransferQueue::TransferQueueImpl {
+	/**
+	 * @brief The client to transfer through.
+	 */
+	BaseClient& client;
+
+	/**
+	 * @brief The maximum number of transfers in flight at once.
+	 */
+	int maxConcurrent;
+
+	/**
+	 * @brief The number of transfers currently in flight.
+	 */
+	int inFlight = 0;
+
+	/**
+	 * @brief Jobs that have not been started yet, in the order they were added.
+	 */
+	std::deque<TransferJob> pending;
+
+	/**
+	 * @brief Called whenever a job finishes.
+	 */
+	JobCallback callback = nullptr;
+
+	/**
+	 * @brief The statistics so far. The elapsed time is only filled in when they are returned.
+	 */
+	TransferStats stats;
+
+	/**
+	 * @brief When the queue was first run.
+	 */
+	std::optional<std::chrono::steady_clock::time_point> start;
+
+	/**
+	 * @brief True if the concurrency is adjusted by AIMD.
+	 */
+	bool adaptive = false;
+	int adaptiveMin = 1;
+	int adaptiveMax = 1;
+	std::chrono::steady_clock::duration epoch = std::chrono::seconds(1);
+
+	/**
+	 * @brief When the current epoch started, and the bytes moved so far in it.
+	 */
+	std::chrono::steady_clock::time_point epochStart = std::chrono::steady_clock::now();
+	uint64_t epochBytes = 0;
+
+	/**
+	 * @brief True once the client has reported progress. Until then, bytes are only counted when a job finishes.
+	 */
+	bool clientReportsProgress = false;
+
+	/**
+	 * @brief The token of the observer registered with the client while the concurrency is adaptive.
+	 */
+	std::optional<uint64_t> observer;
+
+	/**
+	 * @brief The throughput of the last epoch in bytes per second, or 0 if there was none.
+	 */
+	double lastThroughput = 0;
+
+	/**
+	 * @brief True if the concurrency was already decreased this epoch, so one burst of errors only counts once.
+	 */
+	bool decreased = false;
+
+	/**
+	 * @brief Wakes up run() when a transfer finishes or a job is added.
+	 */
+	std::condition_variable cv;
+
+	/**
+	 * @brief Needed to prevent data races.
+	 */
+	mutable std::mutex m;
+
+	TransferQueueImpl(BaseClient& client, int maxConcurrent): client(client), maxConcurrent(maxConcurrent) {}
+
+	/**
+	 * @brief Halves the concurrency unless it was already decreased this epoch. m must be held.
+	 */
+	void decrease(const char* reason) {
+		if (!adaptive || decreased) {
+			return;
+		}
+		maxConcurrent = std::max(adaptiveMin, maxConcurrent / 2);
+		decreased = true;
+		LOG(LEVEL_DEBUG) << "TransferQueue: " << reason << ", concurrency is now " << maxConcurrent;
+	}
+
+	/**
+	 * @brief Adjusts the concurrency if the current epoch is over. m must be held.
+	 */
+	void endEpoch() {
+		auto now = std::chrono::steady_clock::now();
+		if (!adaptive || now - epochStart < epoch) {
+			return;
+		}
+
+		double throughput = epochBytes / std::chrono::duration<double>(now - epochStart).count();
+		// Without progress reports, an epoch in which no job happened to finish says nothing about the throughput.
+		bool measured = clientReportsProgress || epochBytes > 0;
+		if (measured && !decreased) {
+			// More concurrency only helps if there is something to run with it.
+			if (throughput > lastThroughput * 1.05 && maxConcurrent < adaptiveMax && !pending.empty()) {
+				maxConcurrent++;
+				LOG(LEVEL_DEBUG) << "TransferQueue: Throughput rose to " << throughput << " B/s, concurrency is now " << maxConcurrent;
+			}
+			else if (throughput < lastThroughput * 0.7) {
+				decrease("Throughput dropped");
+			}
+		}
+
+		if (measured) {
+			lastThroughput = throughput;
+		}
+		epochStart = now;
+		epochBytes = 0;
+		decreased = false;
+	}
+
+	/**
+	 * @brief Records the result of a job. This is called on whichever thread the transfer finished on.
+	 */
+	void finishJob(const TransferJob& job, bool res) {
+		uint64_t bytes = 0;
+		JobCallback cb;
+
+		// Either way the file is on disk once the transfer succeeds.
+		if (res) {
+			try {
+				bytes = fs::size(job.diskPath.c_str());
+			}
+			catch (std::exception& e) {
+				LOG(LEVEL_DEBUG) << "Could not determine the size of \"" << job.diskPath << "\": " << e.what();
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m);
+			cb = callback;
+		}
+		if (cb) {
+			cb(job, res);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m);
+			if (res) {
+				stats.completed++;
+				stats.bytes += bytes;
+				if (!clientReportsProgress) {
+					epochBytes += bytes;
+				}
+			}
+			else {
+				stats.failed++;
+				decrease("A transfer failed");
+			}
+			inFlight--;
+			// Notifying after unlocking would let the destructor see inFlight == 0 and free this before the notification is done.
+			cv.notify_all();
+		}
+	}
+
+	/**
+	 * @brief Starts a job. m must not be held, as the client may finish the job before returning.
+	 */
+	void startJob(const TransferJob& job) {
+		auto onFinish = [this, job](bool res) {
+			finishJob(job, res);
+		};
+
+		switch (job.type) {
+		case TransferType::Upload:
+			client.uploadAsync(job.diskPath.c_str(), job.cloudPath.c_str(), onFinish);
+			break;
+		case TransferType::Download:
+			client.downloadAsync(job.cloudPath.c_str(), job.diskPath.c_str(), onFinish);
+			break;
+		}
+	}
+
+	/**
+	 * @brief Registers the observer that feeds the client's progress and congestion signals into the AIMD state.
+	 * m must not be held, as the client holds its observer lock while calling back into this.
+	 */
+	uint64_t observe() {
+		BaseClient::TransferObserver o;
+
+		o.onCongestion = [this] {
+			std::lock_guard<std::mutex> lock(m);
+			decrease("The client reported congestion");
+		};
+		o.onProgress = [this](uint64_t bytes) {
+			std::lock_guard<std::mutex> lock(m);
+			clientReportsProgress = true;
+			epochBytes += bytes;
+		};
+		return client.addTransferObserver(std::move(o));
+	}
+
+	TransferStats snapshot() const {
+		TransferStats ret = stats;
+		if (start) {
+			ret.elapsed = std::chrono::steady_clock::now() - start.value();
+		}
+		return ret;
+	}
+};
+
+TransferQueue::TransferQueue(BaseClient& client, int maxConcurrent) {
+	if (maxConcurrent < 1) {
+		throw std::invalid_argument("maxConcurrent must be at least 1");
+	}
+	this->impl = std::make_unique<TransferQueueImpl>(client, maxConcurrent);
+}
+
+TransferQueue::~TransferQueue() {
+	std::optional<uint64_t> observer;
+
+	{
+		std::unique_lock<std::mutex> lock(this->impl->m);
+		this->impl->cv.wait(lock, [this]{ return this->impl->inFlight == 0; });
+		observer = this->impl->observer;
+	}
+	if (observer) {
+		this->impl->client.removeTransferObserver(observer.value());
+	}
+}
+
+TransferQueue& TransferQueue::addUpload(const char* diskPath, const char* cloudPath) {
+	{
+		std::lock_guard<std::mutex> lock(this->impl->m);
+		this->impl->pending.push_back({ TransferType::Upload, diskPath, cloudPath });
+	}
+	this->impl->cv.notify_all();
+	return *this;
+}
+
+TransferQueue& TransferQueue::addDownload(const char* cloudPath, const char* diskPath) {
+	{
+		std::lock_guard<std::mutex> lock(this->impl->m);
+		this->impl->pending.push_back({ TransferType::Download, diskPath, cloudPath });
+	}
+	this->impl->cv.notify_all();
+	return *this;
+}
+
+TransferQueue& TransferQueue::setMaxConcurrent(int maxConcurrent) {
+	if (maxConcurrent < 1) {
+		throw std::invalid_argument("maxConcurrent must be at least 1");
+	}
+	{
+		std::lock_guard<std::mutex> lock(this->impl->m);
+		this->impl->maxConcurrent = maxConcurrent;
+	}
+	this->impl->cv.notify_all();
+	return *this;
+}
+
+TransferQueue& TransferQueue::setJobCallback(JobCallback callback) {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->callback = std::move(callback);
+	return *this;
+}
+
+TransferQueue& TransferQueue::setAdaptiveConcurrency(int minConcurrent, int maxConcurrent, std::chrono::milliseconds epoch) {
+	TransferQueueImpl* q = this->impl.get();
+	std::optional<uint64_t> stale;
+	bool needObserver;
+
+	if (maxConcurrent != 0 && (minConcurrent < 1 || maxConcurrent < minConcurrent)) {
+		throw std::invalid_argument("minConcurrent must be at least 1 and maxConcurrent must be at least minConcurrent");
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(q->m);
+		q->adaptive = maxConcurrent != 0;
+		if (q->adaptive) {
+			q->adaptiveMin = minConcurrent;
+			q->adaptiveMax = maxConcurrent;
+			q->epoch = epoch;
+			q->maxConcurrent = std::clamp(q->maxConcurrent, minConcurrent, maxConcurrent);
+			q->epochStart = std::chrono::steady_clock::now();
+			q->epochBytes = 0;
+			q->lastThroughput = 0;
+			q->decreased = false;
+		}
+		else {
+			stale = q->observer;
+			q->observer.reset();
+		}
+		needObserver = q->adaptive && !q->observer;
+	}
+	q->cv.notify_all();
+
+	// The client must not be called with m held, as its observers lock m.
+	if (stale) {
+		q->client.removeTransferObserver(stale.value());
+	}
+	if (needObserver) {
+		uint64_t token = q->observe();
+		bool kept;
+		{
+			std::lock_guard<std::mutex> lock(q->m);
+			kept = q->adaptive && !q->observer;
+			if (kept) {
+				q->observer = token;
+			}
+		}
+		if (!kept) {
+			// Adaptation was switched off or already hooked up by another thread in the meantime.
+			q->client.removeTransferObserver(token);
+		}
+	}
+	return *this;
+}
+
+void TransferQueue::reportCongestion() {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->decrease("Congestion was reported");
+}
+
+int TransferQueue::getMaxConcurrent() const {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	return this->impl->maxConcurrent;
+}
+
+TransferStats TransferQueue::run() {
+	std::unique_lock<std::mutex> lock(this->impl->m);
+	TransferQueueImpl& q = *this->impl;
+
+	if (!q.start) {
+		q.start = std::chrono::steady_clock::now();
+	}
+
+	while (!q.pending.empty() || q.inFlight > 0) {
+		while (!q.pending.empty() && q.inFlight < q.maxConcurrent) {
+			TransferJob job = std::move(q.pending.front());
+			q.pending.pop_front();
+			q.inFlight++;
+
+			lock.unlock();
+			q.startJob(job);
+			lock.lock();
+		}
+
+		// Wake up when a slot frees up for a pending job, or when everything is done.
+		auto ready = [&q]{
+			return (!q.pending.empty() && q.inFlight < q.maxConcurrent) || (q.pending.empty() && q.inFlight == 0);
+		};
+		if (!q.adaptive) {
+			q.cv.wait(lock, ready);
+			continue;
+		}
+		// Epochs end on a timer, so a long transfer that has not finished yet still counts towards each of them.
+		// Jobs may keep finishing before the deadline passes without a wakeup, so the epoch is checked after every wait, not just on a timeout.
+		auto deadline = std::max(q.epochStart + q.epoch, std::chrono::steady_clock::now() + std::chrono::milliseconds(1));
+		q.cv.wait_until(lock, deadline, ready);
+		q.endEpoch();
+	}
+
+	return q.snapshot();
+}
+
+TransferStats TransferQueue::getStats() const {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	return this->impl->snapshot();
+}
+
+}
@@ -0,0 +1,190 @@
+/** @file transferqueue.hpp
+ * @brief Runs many transfers with a bounded number in flight.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#ifndef __CS_TRANSFERQUEUE_HPP
+#define __CS_TRANSFERQUEUE_HPP
+
+#include "baseclient.hpp"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace CloudSync{
+
+/**
+ * @brief The direction of a transfer.
+ */
+enum class TransferType {
+	Upload,
+	Download,
+};
+
+/**
+ * @brief A single file to be transferred.
+ */
+struct TransferJob {
+	TransferType type;
+	std::string diskPath;
+	std::string cloudPath;
+};
+
+/**
+ * @brief Aggregate statistics for the jobs run by a TransferQueue.
+ */
+struct TransferStats {
+	/**
+	 * @brief The number of jobs that finished successfully.
+	 */
+	uint64_t completed = 0;
+	/**
+	 * @brief The number of jobs that failed.
+	 */
+	uint64_t failed = 0;
+	/**
+	 * @brief The number of bytes moved by the successful jobs.
+	 */
+	uint64_t bytes = 0;
+	/**
+	 * @brief How long the queue has been running.
+	 */
+	std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::duration::zero();
+
+	/**
+	 * @brief Returns the aggregate throughput in bytes per second, or 0 if no time has passed.
+	 */
+	double bytesPerSecond() const noexcept;
+};
+
+/**
+ * @brief Runs queued uploads and downloads through a BaseClient's asynchronous API, keeping up to a fixed number of them in flight at once.
+ * This class is thread-safe.
+ */
+class TransferQueue {
+public:
+	/**
+	 * @brief A function that is called whenever a job finishes.
+	 * Its second argument is true if the job was successful, false if not.
+	 * This may be called on a different thread.
+	 */
+	using JobCallback = std::function<void(const TransferJob&, bool)>;
+
+	/**
+	 * @brief Constructs a TransferQueue.
+	 *
+	 * @param client The client to transfer through.
+	 * It must outlive the TransferQueue.
+	 * @param maxConcurrent The maximum number of transfers in flight at once.
+	 *
+	 * @exception std::invalid_argument maxConcurrent is less than 1.
+	 */
+	TransferQueue(BaseClient& client, int maxConcurrent = 8);
+
+	/**
+	 * @brief Waits for any transfers that are still in flight, and removes the queue's observer from the client if adaptive concurrency is on.
+	 */
+	~TransferQueue();
+
+	/**
+	 * @brief Queues a file to be uploaded.
+	 *
+	 * @param diskPath The file to be uploaded.
+	 * @param cloudPath The location the file should be uploaded to.
+	 *
+	 * @return this
+	 */
+	TransferQueue& addUpload(const char* diskPath, const char* cloudPath);
+
+	/**
+	 * @brief Queues a file to be downloaded.
+	 *
+	 * @param cloudPath The file to be downloaded.
+	 * @param diskPath The location the file should be downloaded to.
+	 *
+	 * @return this
+	 */
+	TransferQueue& addDownload(const char* cloudPath, const char* diskPath);
+
+	/**
+	 * @brief Sets the maximum number of transfers in flight at once.
+	 * This can be changed while the queue is running.
+	 *
+	 * @param maxConcurrent The maximum to set.
+	 *
+	 * @return this
+	 *
+	 * @exception std::invalid_argument maxConcurrent is less than 1.
+	 */
+	TransferQueue& setMaxConcurrent(int maxConcurrent);
+
+	/**
+	 * @brief Sets the function that is called whenever a job finishes.
+	 *
+	 * @param callback The function to call, or nullptr for none.
+	 *
+	 * @return this
+	 */
+	TransferQueue& setJobCallback(JobCallback callback);
+
+	/**
+	 * @brief Lets the queue find its own concurrency instead of using a fixed one (additive increase, multiplicative decrease).
+	 * The throughput is measured over every epoch. If it rose, one more transfer is allowed in flight.
+	 * A failed transfer, a sign of congestion from the client, or a sharp drop in throughput halves the concurrency, at most once per epoch.
+	 * The concurrency set with setMaxConcurrent() or the constructor is where the search starts.
+	 *
+	 * Bytes are counted as the client reports transfer progress, so transfers still in flight count towards every epoch they span.
+	 * Clients that do not report progress only have their bytes counted when a job finishes.
+	 * Progress is reported per client, so queues sharing a client each measure their combined throughput.
+	 *
+	 * @param minConcurrent The lowest concurrency to back off to.
+	 * @param maxConcurrent The highest concurrency to probe up to, or 0 to stop adapting and keep the current concurrency.
+	 * @param epoch How long throughput is measured over before each adjustment.
+	 *
+	 * @return this
+	 *
+	 * @exception std::invalid_argument minConcurrent is less than 1, or maxConcurrent is less than minConcurrent and not 0.
+	 */
+	TransferQueue& setAdaptiveConcurrency(int minConcurrent, int maxConcurrent, std::chrono::milliseconds epoch = std::chrono::seconds(1));
+
+	/**
+	 * @brief Reports a sign of congestion, which halves the concurrency if it is adaptive.
+	 * The client's congestion signals are passed on to this while the concurrency is adaptive.
+	 */
+	void reportCongestion();
+
+	/**
+	 * @brief Gets the maximum number of transfers currently allowed in flight at once.
+	 */
+	int getMaxConcurrent() const;
+
+	/**
+	 * @brief Runs every queued job, blocking until all of them have finished.
+	 * Jobs added from another thread while this is running are also run.
+	 *
+	 * @return The statistics for the jobs run so far.
+	 */
+	TransferStats run();
+
+	/**
+	 * @brief Gets the statistics for the jobs run so far.
+	 * This can be called while the queue is running.
+	 */
+	TransferStats getStats() const;
+
+private:
+	struct TransferQueueImpl;
+	/**
+	 * @brief A pointer to the private variables and inner workings of the TransferQueue class.
+	 */
+	std::unique_ptr<TransferQueueImpl> impl;
+};
+
+}
+
+#endif
@@ -0,0 +1,197 @@
+/** @file transferscheduler.cpp
+ * @brief Runs transfers in lanes by size class, so large files cannot hold up small ones.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "transferscheduler.hpp"
+#include "fs/file.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace CloudSync {
+
+/**
+ * @brief A job along with its size, which decides its lane and its place in it.
+ */
+struct SizedJob {
+	TransferJob job;
+	std::optional<uint64_t> size;
+};
+
+struct TransferScheduler::TransferSchedulerImpl {
+	/**
+	 * @brief The client to transfer through.
+	 */
+	BaseClient& client;
+
+	uint64_t largeThreshold;
+	int smallConcurrent;
+	int largeConcurrent;
+
+	/**
+	 * @brief Jobs that have not been run yet.
+	 */
+	std::vector<SizedJob> pending;
+
+	/**
+	 * @brief Called whenever a job finishes.
+	 */
+	TransferQueue::JobCallback callback = nullptr;
+
+	/**
+	 * @brief Needed to prevent data races.
+	 */
+	std::mutex m;
+
+	TransferSchedulerImpl(BaseClient& client, uint64_t largeThreshold, int smallConcurrent, int largeConcurrent): client(client), largeThreshold(largeThreshold), smallConcurrent(smallConcurrent), largeConcurrent(largeConcurrent) {}
+
+	/**
+	 * @brief Fills in the size of every job that does not have one yet.
+	 * Uploads are sized from the disk. Downloads are grouped by their cloud directory, and a directory with several of them is listed once with readdirPlus() instead of sending a stat() per file.
+	 * A job whose size cannot be determined is treated as empty, as it is most likely going to fail quickly.
+	 */
+	void resolveSizes(std::vector<SizedJob>& jobs) {
+		std::map<std::string, std::vector<SizedJob*>> byDir;
+
+		for (SizedJob& sj : jobs) {
+			if (sj.size) {
+				continue;
+			}
+			switch (sj.job.type) {
+			case TransferType::Upload:
+				try {
+					sj.size = fs::size(sj.job.diskPath.c_str());
+				}
+				catch (std::exception& e) {
+					LOG(LEVEL_DEBUG) << "Could not determine the size of \"" << sj.job.diskPath << "\": " << e.what();
+					sj.size = 0;
+				}
+				break;
+			case TransferType::Download:
+				byDir[fs::parentDir(sj.job.cloudPath.c_str())].push_back(&sj);
+				break;
+			}
+		}
+
+		for (auto& dir : byDir) {
+			std::vector<SizedJob*>& group = dir.second;
+			struct stat st;
+
+			// Listing a whole directory for one file would cost more than the stat() it saves.
+			if (group.size() == 1) {
+				group[0]->size = client.stat(group[0]->job.cloudPath.c_str(), &st) ? st.st_size : 0;
+				continue;
+			}
+
+			std::unordered_map<std::string, uint64_t> sizes;
+			std::optional<std::vector<DirEntry>> entries = client.readdirPlus(dir.first.c_str());
+			if (entries) {
+				for (const DirEntry& entry : entries.value()) {
+					sizes.emplace(entry.name, entry.st.st_size);
+				}
+			}
+			else {
+				LOG(LEVEL_DEBUG) << "Could not list \"" << dir.first << "\" to size " << group.size() << " downloads";
+			}
+			for (SizedJob* sj : group) {
+				auto it = sizes.find(std::filesystem::path(sj->job.cloudPath).filename().string());
+				sj->size = it != sizes.end() ? it->second : 0;
+			}
+		}
+	}
+};
+
+TransferScheduler::TransferScheduler(BaseClient& client, uint64_t largeThreshold, int smallConcurrent, int largeConcurrent) {
+	if (smallConcurrent < 1 || largeConcurrent < 1) {
+		throw std::invalid_argument("smallConcurrent and largeConcurrent must be at least 1");
+	}
+	this->impl = std::make_unique<TransferSchedulerImpl>(client, largeThreshold, smallConcurrent, largeConcurrent);
+}
+
+TransferScheduler::~TransferScheduler() = default;
+
+TransferScheduler& TransferScheduler::addUpload(const char* diskPath, const char* cloudPath) {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->pending.push_back({ { TransferType::Upload, diskPath, cloudPath }, std::nullopt });
+	return *this;
+}
+
+TransferScheduler& TransferScheduler::addDownload(const char* cloudPath, const char* diskPath, std::optional<uint64_t> size) {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->pending.push_back({ { TransferType::Download, diskPath, cloudPath }, size });
+	return *this;
+}
+
+TransferScheduler& TransferScheduler::setJobCallback(TransferQueue::JobCallback callback) {
+	std::lock_guard<std::mutex> lock(this->impl->m);
+	this->impl->callback = std::move(callback);
+	return *this;
+}
+
+TransferStats TransferScheduler::run() {
+	TransferSchedulerImpl& s = *this->impl;
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<SizedJob> jobs;
+	TransferQueue::JobCallback callback;
+	TransferStats smallStats;
+	TransferStats largeStats;
+	TransferStats ret;
+
+	{
+		std::lock_guard<std::mutex> lock(s.m);
+		jobs.swap(s.pending);
+		callback = s.callback;
+	}
+
+	s.resolveSizes(jobs);
+	// Smallest first, except the large lane, whose boundary is crossed in the other direction.
+	std::stable_sort(jobs.begin(), jobs.end(), [](const SizedJob& a, const SizedJob& b) {
+		return a.size.value() < b.size.value();
+	});
+	auto boundary = std::partition_point(jobs.begin(), jobs.end(), [&s](const SizedJob& sj) {
+		return sj.size.value() < s.largeThreshold;
+	});
+	std::reverse(boundary, jobs.end());
+
+	TransferQueue small(s.client, s.smallConcurrent);
+	TransferQueue large(s.client, s.largeConcurrent);
+	small.setJobCallback(callback);
+	large.setJobCallback(callback);
+	for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+		TransferQueue& lane = it < boundary ? small : large;
+		if (it->job.type == TransferType::Upload) {
+			lane.addUpload(it->job.diskPath.c_str(), it->job.cloudPath.c_str());
+		}
+		else {
+			lane.addDownload(it->job.cloudPath.c_str(), it->job.diskPath.c_str());
+		}
+	}
+	LOG(LEVEL_DEBUG) << "Scheduling " << (boundary - jobs.begin()) << " small and " << (jobs.end() - boundary) << " large transfers";
+
+	// Whichever lane finishes first hands its slots to the other.
+	std::thread smallThread([&] {
+		smallStats = small.run();
+		large.setMaxConcurrent(s.largeConcurrent + s.smallConcurrent);
+	});
+	largeStats = large.run();
+	small.setMaxConcurrent(s.smallConcurrent + s.largeConcurrent);
+	smallThread.join();
+
+	ret.completed = smallStats.completed + largeStats.completed;
+	ret.failed = smallStats.failed + largeStats.failed;
+	ret.bytes = smallStats.bytes + largeStats.bytes;
+	ret.elapsed = std::chrono::steady_clock::now() - start;
+	return ret;
+}
+
+}
@@ -0,0 +1,91 @@
+/** @file transferscheduler.hpp
+ * @brief Runs transfers in lanes by size class, so large files cannot hold up small ones.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#ifndef __CS_TRANSFERSCHEDULER_HPP
+#define __CS_TRANSFERSCHEDULER_HPP
+
+#include "transferqueue.hpp"
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace CloudSync{
+
+/**
+ * @brief Splits transfers into a small-file lane and a large-file lane that run side by side through the same BaseClient.
+ *
+ * Small files are bound by the request rate, so the small lane keeps many of them in flight at once and starts the smallest first, to finish as many as possible early.
+ * Large files are bound by bandwidth, so the large lane keeps only a few in flight and starts the largest first, so the longest transfer is not left for last.
+ * Because the lanes are independent, a 20 GB upload occupies one slot of the large lane instead of stalling thousands of small files queued behind it.
+ * When one lane runs dry, the other takes over its slots.
+ *
+ * This class is thread-safe.
+ */
+class TransferScheduler {
+public:
+	/**
+	 * @brief Constructs a TransferScheduler.
+	 *
+	 * @param client The client to transfer through.
+	 * It must outlive the TransferScheduler.
+	 * @param largeThreshold Files at least this many bytes large go in the large lane.
+	 * @param smallConcurrent The maximum number of small files in flight at once.
+	 * @param largeConcurrent The maximum number of large files in flight at once.
+	 *
+	 * @exception std::invalid_argument smallConcurrent or largeConcurrent is less than 1.
+	 */
+	TransferScheduler(BaseClient& client, uint64_t largeThreshold = 64 * 1024 * 1024, int smallConcurrent = 16, int largeConcurrent = 4);
+	~TransferScheduler();
+
+	/**
+	 * @brief Schedules a file to be uploaded. Its size is read from the disk when the scheduler runs.
+	 *
+	 * @param diskPath The file to be uploaded.
+	 * @param cloudPath The location the file should be uploaded to.
+	 *
+	 * @return this
+	 */
+	TransferScheduler& addUpload(const char* diskPath, const char* cloudPath);
+
+	/**
+	 * @brief Schedules a file to be downloaded.
+	 *
+	 * @param cloudPath The file to be downloaded.
+	 * @param diskPath The location the file should be downloaded to.
+	 * @param size The size of the file if it is already known, such as from readdirPlus().
+	 * Otherwise it is looked up when the scheduler runs. Downloads from the same cloud directory share a single readdirPlus() call, and a lone one costs a stat().
+	 *
+	 * @return this
+	 */
+	TransferScheduler& addDownload(const char* cloudPath, const char* diskPath, std::optional<uint64_t> size = std::nullopt);
+
+	/**
+	 * @brief Sets the function that is called whenever a job finishes.
+	 * This may be called on a different thread.
+	 *
+	 * @param callback The function to call, or nullptr for none.
+	 *
+	 * @return this
+	 */
+	TransferScheduler& setJobCallback(TransferQueue::JobCallback callback);
+
+	/**
+	 * @brief Runs every scheduled job, blocking until all of them have finished.
+	 *
+	 * @return The combined statistics of both lanes.
+	 */
+	TransferStats run();
+
+private:
+	struct TransferSchedulerImpl;
+	std::unique_ptr<TransferSchedulerImpl> impl;
+};
+
+}
+
+#endif
@@ -0,0 +1,407 @@
+/** @file treediff.cpp
+ * @brief Compares a local directory tree with a remote one and plans the operations that bring them in sync.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "treediff.hpp"
+#include "fs/treewalker.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <sys/stat.h>
+#include <unordered_map>
+
+namespace CloudSync {
+
+/**
+ * @brief A file or directory on either side, with its path relative to the root.
+ */
+struct TreeEntry {
+	std::string path;
+	bool dir;
+	uint64_t size;
+	int64_t mtime;
+};
+
+/**
+ * @brief Orders paths depth-first by treating '/' as lower than every other character.
+ * This way everything under "/a" comes right after "/a" and before "/a.txt", so a whole subtree can be skipped in one stretch.
+ */
+static int compare_paths(const std::string& a, const std::string& b) {
+	size_t len = std::min(a.size(), b.size());
+
+	for (size_t i = 0; i < len; ++i) {
+		if (a[i] != b[i]) {
+			if (a[i] == '/') {
+				return -1;
+			}
+			if (b[i] == '/') {
+				return 1;
+			}
+			return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[i]) ? -1 : 1;
+		}
+	}
+	return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+}
+
+static void sort_entries(std::vector<TreeEntry>& entries) {
+	std::sort(entries.begin(), entries.end(), [](const TreeEntry& a, const TreeEntry& b) {
+		return compare_paths(a.path, b.path) < 0;
+	});
+}
+
+/**
+ * @brief The position of an operation in the plan. Operations are ordered by phase and then by path.
+ */
+enum Phase {
+	PHASE_REPLACE,
+	PHASE_MKDIR,
+	PHASE_MOVE,
+	PHASE_TRANSFER,
+	PHASE_DELETE,
+	PHASE_CONFLICT,
+};
+
+/**
+ * @brief Merges the two sorted listings into a plan.
+ */
+class Planner {
+public:
+	Planner(SyncDirection direction, bool detectMoves): direction(direction), detectMoves(detectMoves && direction != SyncDirection::Bidirectional) {}
+
+	std::vector<SyncOp> run(const std::vector<TreeEntry>& local, const std::vector<TreeEntry>& remote) {
+		size_t l = 0;
+		size_t r = 0;
+
+		while (l < local.size() || r < remote.size()) {
+			int cmp = l == local.size() ? 1 : r == remote.size() ? -1 : compare_paths(local[l].path, remote[r].path);
+			if (cmp < 0) {
+				onlyOn(local[l++], true);
+			}
+			else if (cmp > 0) {
+				onlyOn(remote[r++], false);
+			}
+			else {
+				both(local[l++], remote[r++]);
+			}
+		}
+
+		if (detectMoves) {
+			findMoves();
+		}
+
+		std::stable_sort(ops.begin(), ops.end(), [](const PlannedOp& a, const PlannedOp& b) {
+			return a.phase < b.phase;
+		});
+		std::vector<SyncOp> ret;
+		ret.reserve(ops.size());
+		for (PlannedOp& op : ops) {
+			if (!op.dropped) {
+				ret.push_back(std::move(op.op));
+			}
+		}
+		return ret;
+	}
+
+private:
+	struct PlannedOp {
+		SyncOp op;
+		Phase phase;
+		bool dropped = false;
+	};
+
+	/**
+	 * @brief What to do with the entries under a directory that an operation already took care of.
+	 */
+	enum class SkipMode {
+		/**
+		 * @brief The directory is being deleted. Its files can still be the sources of moves.
+		 */
+		Delete,
+		/**
+		 * @brief The directory is being deleted to make room for a file, which happens before moves do, or is in conflict.
+		 */
+		Ignore,
+	};
+
+	struct Skip {
+		std::string prefix;
+		SkipMode mode = SkipMode::Ignore;
+
+		bool covers(const std::string& path) const {
+			return !prefix.empty() && path.compare(0, prefix.size(), prefix) == 0;
+		}
+	};
+
+	/**
+	 * @brief A file that a move could take the place of a delete or a transfer for.
+	 */
+	struct MoveCandidate {
+		std::string path;
+		/**
+		 * @brief The operation the move would replace, or NO_OP if the file has none because it is under a deleted directory.
+		 */
+		size_t op;
+	};
+
+	static constexpr size_t NO_OP = SIZE_MAX;
+
+	struct KeyHash {
+		size_t operator()(const std::pair<uint64_t, int64_t>& key) const {
+			return std::hash<uint64_t>()(key.first) * 31 + std::hash<int64_t>()(key.second);
+		}
+	};
+	using CandidateMap = std::unordered_map<std::pair<uint64_t, int64_t>, std::vector<MoveCandidate>, KeyHash>;
+
+	SyncDirection direction;
+	bool detectMoves;
+	std::vector<PlannedOp> ops;
+	Skip skipLocal;
+	Skip skipRemote;
+	CandidateMap sources;
+	CandidateMap destinations;
+
+	void add(SyncOpType type, const std::string& path, Phase phase) {
+		ops.push_back({ { type, path, "" }, phase });
+	}
+
+	/**
+	 * @brief Remembers a file that is deleted from the target side, or is under a directory that is.
+	 */
+	void addSource(const TreeEntry& e, size_t op) {
+		if (detectMoves && e.size > 0) {
+			sources[{ e.size, e.mtime }].push_back({ e.path, op });
+		}
+	}
+
+	/**
+	 * @brief Remembers a file that is transferred to a path that does not exist on the target side.
+	 */
+	void addDestination(const TreeEntry& e) {
+		if (detectMoves && e.size > 0) {
+			destinations[{ e.size, e.mtime }].push_back({ e.path, ops.size() - 1 });
+		}
+	}
+
+	/**
+	 * @brief Handles an entry that only exists on one side.
+	 */
+	void onlyOn(const TreeEntry& e, bool isLocal) {
+		Skip& skip = isLocal ? skipLocal : skipRemote;
+		// Whether the entry's side is the one that is copied from.
+		bool isSource = direction == SyncDirection::Bidirectional || isLocal == (direction == SyncDirection::Upload);
+
+		if (skip.covers(e.path)) {
+			if (skip.mode == SkipMode::Delete && !e.dir) {
+				addSource(e, NO_OP);
+			}
+			return;
+		}
+
+		if (isSource) {
+			if (e.dir) {
+				add(isLocal ? SyncOpType::MkdirRemote : SyncOpType::MkdirLocal, e.path, PHASE_MKDIR);
+			}
+			else {
+				add(isLocal ? SyncOpType::Upload : SyncOpType::Download, e.path, PHASE_TRANSFER);
+				addDestination(e);
+			}
+			return;
+		}
+
+		add(isLocal ? SyncOpType::DeleteLocal : SyncOpType::DeleteRemote, e.path, PHASE_DELETE);
+		if (e.dir) {
+			skip = { e.path + '/', SkipMode::Delete };
+		}
+		else {
+			addSource(e, ops.size() - 1);
+		}
+	}
+
+	/**
+	 * @brief Handles a path that exists on both sides.
+	 */
+	void both(const TreeEntry& local, const TreeEntry& remote) {
+		if (local.dir && remote.dir) {
+			return;
+		}
+
+		if (!local.dir && !remote.dir) {
+			if (local.size == remote.size && local.mtime == remote.mtime) {
+				return;
+			}
+			switch (direction) {
+			case SyncDirection::Upload:
+				add(SyncOpType::Upload, local.path, PHASE_TRANSFER);
+				break;
+			case SyncDirection::Download:
+				add(SyncOpType::Download, local.path, PHASE_TRANSFER);
+				break;
+			case SyncDirection::Bidirectional:
+				if (local.mtime == remote.mtime) {
+					add(SyncOpType::Conflict, local.path, PHASE_CONFLICT);
+				}
+				else {
+					add(local.mtime > remote.mtime ? SyncOpType::Upload : SyncOpType::Download, local.path, PHASE_TRANSFER);
+				}
+				break;
+			}
+			return;
+		}
+
+		// A file on one side and a directory on the other.
+		if (direction == SyncDirection::Bidirectional) {
+			add(SyncOpType::Conflict, local.path, PHASE_CONFLICT);
+			(local.dir ? skipLocal : skipRemote) = { local.path + '/', SkipMode::Ignore };
+			return;
+		}
+
+		bool upload = direction == SyncDirection::Upload;
+		const TreeEntry& src = upload ? local : remote;
+		const TreeEntry& dst = upload ? remote : local;
+
+		add(upload ? SyncOpType::DeleteRemote : SyncOpType::DeleteLocal, dst.path, PHASE_REPLACE);
+		if (dst.dir) {
+			(upload ? skipRemote : skipLocal) = { dst.path + '/', SkipMode::Ignore };
+		}
+		if (src.dir) {
+			add(upload ? SyncOpType::MkdirRemote : SyncOpType::MkdirLocal, src.path, PHASE_MKDIR);
+		}
+		else {
+			add(upload ? SyncOpType::Upload : SyncOpType::Download, src.path, PHASE_TRANSFER);
+			addDestination(src);
+		}
+	}
+
+	/**
+	 * @brief Turns a transfer into a move wherever its size and mtime identify exactly one deleted file.
+	 */
+	void findMoves() {
+		SyncOpType moveType = direction == SyncDirection::Upload ? SyncOpType::MoveRemote : SyncOpType::MoveLocal;
+
+		for (const auto& dst : destinations) {
+			auto src = sources.find(dst.first);
+			if (dst.second.size() != 1 || src == sources.end() || src->second.size() != 1) {
+				continue;
+			}
+
+			PlannedOp& op = ops[dst.second.front().op];
+			op.op.type = moveType;
+			op.op.from = src->second.front().path;
+			op.phase = PHASE_MOVE;
+			if (src->second.front().op != NO_OP) {
+				ops[src->second.front().op].dropped = true;
+			}
+		}
+	}
+};
+
+struct TreeDiff::TreeDiffImpl {
+	std::string localDir;
+	SyncDirection direction;
+	bool detectMoves = true;
+
+	/**
+	 * @brief Walks the local tree into a sorted listing.
+	 */
+	std::vector<TreeEntry> listLocal() {
+		fs::TreeWalker walker(localDir.c_str(), true);
+		std::vector<TreeEntry> ret;
+		const char* entry;
+
+		while ((entry = walker.nextEntry()) != nullptr) {
+			struct stat st;
+			std::string path = entry;
+
+			if (lstat(entry, &st) != 0) {
+				LOG(LEVEL_DEBUG) << "Failed to stat \"" << entry << "\"";
+				continue;
+			}
+			if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+				LOG(LEVEL_DEBUG) << "Ignoring \"" << entry << "\", as it is not a regular file or directory";
+				continue;
+			}
+
+			// The walker's paths start with the base directory as it was given.
+			path.erase(0, localDir.size());
+			if (path.empty() || path.front() != '/') {
+				path.insert(path.begin(), '/');
+			}
+			ret.push_back({ std::move(path), S_ISDIR(st.st_mode), S_ISDIR(st.st_mode) ? 0 : static_cast<uint64_t>(st.st_size), st.st_mtime });
+		}
+
+		sort_entries(ret);
+		return ret;
+	}
+
+	/**
+	 * @brief Flattens a remote index into a sorted listing.
+	 */
+	static std::vector<TreeEntry> listRemote(const RemoteIndex& remote) {
+		// Only directories' paths are needed, as only directories have children.
+		std::vector<std::string> dirPaths(remote.count());
+		std::vector<TreeEntry> ret;
+
+		ret.reserve(remote.count() - 1);
+		// Parents come before their children in the index, so their paths are always ready.
+		for (uint32_t i = 1; i < remote.count(); ++i) {
+			std::string path = dirPaths[remote.parent(i)];
+			path += '/';
+			path += remote.name(i);
+			if (remote.isDirectory(i)) {
+				dirPaths[i] = path;
+			}
+			ret.push_back({ std::move(path), remote.isDirectory(i), remote.isDirectory(i) ? 0 : remote.size(i), remote.mtime(i) });
+		}
+
+		sort_entries(ret);
+		return ret;
+	}
+
+	std::vector<SyncOp> plan(const std::vector<TreeEntry>& local, const std::vector<TreeEntry>& remote) {
+		std::vector<SyncOp> ret = Planner(direction, detectMoves).run(local, remote);
+		LOG(LEVEL_DEBUG) << "Compared " << local.size() << " local and " << remote.size() << " remote entries into " << ret.size() << " operations";
+		return ret;
+	}
+};
+
+TreeDiff::TreeDiff(const char* localDir, SyncDirection direction): impl(std::make_unique<TreeDiffImpl>()) {
+	this->impl->localDir = localDir;
+	this->impl->direction = direction;
+}
+
+TreeDiff::~TreeDiff() = default;
+
+TreeDiff& TreeDiff::setMoveDetection(bool enabled) {
+	this->impl->detectMoves = enabled;
+	return *this;
+}
+
+std::optional<std::vector<SyncOp>> TreeDiff::diff(BaseClient& client, const char* remoteDir) {
+	std::future<std::vector<TreeEntry>> local = std::async(std::launch::async, [this] {
+		return this->impl->listLocal();
+	});
+	std::optional<RemoteIndex> remote = RemoteIndex::build(client, remoteDir);
+	// This rethrows whatever the walk threw.
+	std::vector<TreeEntry> localEntries = local.get();
+
+	if (!remote) {
+		return std::nullopt;
+	}
+	return this->impl->plan(localEntries, TreeDiffImpl::listRemote(*remote));
+}
+
+std::vector<SyncOp> TreeDiff::diff(const RemoteIndex& remote) {
+	std::future<std::vector<TreeEntry>> local = std::async(std::launch::async, [this] {
+		return this->impl->listLocal();
+	});
+	std::vector<TreeEntry> remoteEntries = TreeDiffImpl::listRemote(remote);
+
+	return this->impl->plan(local.get(), remoteEntries);
+}
+
+}
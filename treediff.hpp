@@ -0,0 +1,146 @@
+/** @file treediff.hpp
+ * @brief Compares a local directory tree with a remote one and plans the operations that bring them in sync.
+ * @copyright Copyright (c) 2018 Jonathan Lemos
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#ifndef __CS_TREEDIFF_HPP
+#define __CS_TREEDIFF_HPP
+
+#include "baseclient.hpp"
+#include "remoteindex.hpp"
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace CloudSync{
+
+/**
+ * @brief Which side of a sync is authoritative.
+ */
+enum class SyncDirection {
+	/**
+	 * @brief Make the remote tree a copy of the local one, deleting what is only on the remote.
+	 */
+	Upload,
+	/**
+	 * @brief Make the local tree a copy of the remote one, deleting what is only on the local side.
+	 */
+	Download,
+	/**
+	 * @brief Copy what is missing in either direction and keep the newer of two differing files. Nothing is deleted.
+	 */
+	Bidirectional,
+};
+
+enum class SyncOpType {
+	MkdirLocal,
+	MkdirRemote,
+	/**
+	 * @brief Move the local file at SyncOp::from to SyncOp::path.
+	 */
+	MoveLocal,
+	/**
+	 * @brief Move the remote file at SyncOp::from to SyncOp::path.
+	 */
+	MoveRemote,
+	Upload,
+	Download,
+	/**
+	 * @brief Delete a local file or directory along with everything in it.
+	 */
+	DeleteLocal,
+	/**
+	 * @brief Delete a remote file or directory along with everything in it.
+	 */
+	DeleteRemote,
+	/**
+	 * @brief The two sides differ in a way that cannot be resolved automatically, such as a file on one side and a directory on the other in a bidirectional sync.
+	 */
+	Conflict,
+};
+
+/**
+ * @brief A single step of a sync plan.
+ */
+struct SyncOp {
+	SyncOpType type;
+	/**
+	 * @brief The path the operation acts on relative to both roots, such as "/a/b". For a move, this is the destination.
+	 */
+	std::string path;
+	/**
+	 * @brief The source of a move. Empty for every other operation.
+	 */
+	std::string from;
+};
+
+/**
+ * @brief Compares a local directory with a remote one and produces a sync plan.
+ *
+ * Both trees are flattened into lists sorted in depth-first order and merged in a single pass, so no path is ever looked up in the other tree.
+ * When the remote tree has to be listed, that runs at the same time as the walk over the local tree.
+ * Files are considered equal if their sizes and modification times (in seconds) match.
+ *
+ * A file that would be deleted on the target side and one that would be transferred to it, with the same size and modification time and no other file sharing them, are taken to be the same file that was moved. The transfer then becomes a move on the target side.
+ *
+ * The plan is ordered so it can be run from front to back: deletes that make room for an entry of another type, then mkdirs parents first, then moves, then transfers, then the remaining deletes. Conflicts come last.
+ * A directory that is deleted appears only once; everything in it is implied.
+ * Symlinks and special files on the local side are ignored.
+ */
+class TreeDiff {
+public:
+	/**
+	 * @brief Constructs a TreeDiff.
+	 *
+	 * @param localDir The local directory to compare.
+	 * @param direction Which side is authoritative.
+	 */
+	TreeDiff(const char* localDir, SyncDirection direction = SyncDirection::Upload);
+	~TreeDiff();
+
+	/**
+	 * @brief Sets whether moves are detected. If not, a moved file is transferred again and its old copy is deleted.
+	 * This is on by default.
+	 *
+	 * @return this
+	 */
+	TreeDiff& setMoveDetection(bool enabled);
+
+	/**
+	 * @brief Lists the remote tree and compares it with the local one.
+	 *
+	 * @param client The client to list the remote tree through.
+	 * @param remoteDir The remote directory to compare.
+	 *
+	 * @return The sync plan, or std::nullopt if the remote tree could not be listed.
+	 *
+	 * @exception fs::NotFoundException The local directory does not exist.
+	 * @exception fs::IOException There was an I/O error walking the local tree.
+	 */
+	std::optional<std::vector<SyncOp>> diff(BaseClient& client, const char* remoteDir);
+
+	/**
+	 * @brief Compares a snapshot of the remote tree with the local one.
+	 * This does not touch the network at all.
+	 *
+	 * @param remote The snapshot of the remote directory to compare.
+	 *
+	 * @return The sync plan.
+	 *
+	 * @exception fs::NotFoundException The local directory does not exist.
+	 * @exception fs::IOException There was an I/O error walking the local tree.
+	 */
+	std::vector<SyncOp> diff(const RemoteIndex& remote);
+
+private:
+	struct TreeDiffImpl;
+	std::unique_ptr<TreeDiffImpl> impl;
+};
+
+}
+
+#endif